@@ -1,64 +1,80 @@
 #pragma once
 
 #include "rtweekend.hpp"
+#include "stats.hpp"
 
-class aabb
+/// @brief 轴对齐包围盒，模板参数是标量类型，渲染使用aabb = basic_aabb<real>
+template <typename T>
+class basic_aabb
 {
 public:
-    constexpr aabb() noexcept = default;
+    using vector_type = basic_vec3<T>;
 
-    constexpr aabb(const vec3& a, const vec3& b) noexcept
+    constexpr basic_aabb() noexcept = default;
+
+    constexpr basic_aabb(const vector_type& a, const vector_type& b) noexcept
         : _min(a)
         , _max(b)
     {
     }
 
-    /// @brief
+    /// @brief 光线与包围盒求交，使用方向的倒数，每个轴只做一次除法，没有提前退出的分支
     /// @param r
     /// @param tmin 时间最小值
     /// @param tmax 时间最大值
     /// @return
-    bool hit(const ray& r, double tmin, double tmax) const noexcept
+    bool hit(const basic_ray<T>& r, T tmin, T tmax) const noexcept
     {
+        stats::count_box_test();
+
+        const vector_type origin    = r.origin();
+        const vector_type direction = r.direction();
+
         for (size_t i = 0; i < 3; ++i)
         {
-            auto t0 = ffmin((_min[i] - r.origin()[i]) / r.direction()[i], (_max[i] - r.origin()[i]) / r.direction()[i]);
-            auto t1 = ffmax((_min[i] - r.origin()[i]) / r.direction()[i], (_max[i] - r.origin()[i]) / r.direction()[i]);
-
-            tmin = ffmax(t0, tmin);
-            tmax = ffmin(t1, tmax);
+            const T inv_d = 1 / direction[i];
+            const auto t0    = (_min[i] - origin[i]) * inv_d;
+            const auto t1    = (_max[i] - origin[i]) * inv_d;
 
-            if (tmax <= tmin)
-            {
-                return false;
-            }
+            tmin = ffmax(ffmin(t0, t1), tmin);
+            tmax = ffmin(ffmax(t0, t1), tmax);
         }
 
-        return true;
+        return tmin < tmax;
     }
 
-    constexpr vec3 min() const noexcept
+    constexpr vector_type min() const noexcept
     {
         return _min;
     }
 
-    constexpr vec3 max() const noexcept
+    constexpr vector_type max() const noexcept
     {
         return _max;
     }
 
+    /// @brief 包围盒的表面积，用于SAH代价估计
+    T surface_area() const noexcept
+    {
+        auto d = _max - _min;
+        return 2 * (d.x() * d.y() + d.y() * d.z() + d.z() * d.x());
+    }
+
 private:
-    vec3 _min;
-    vec3 _max;
+    vector_type _min;
+    vector_type _max;
 };
 
+using aabb = basic_aabb<real>;
+
 /// @brief 计算包围盒的包围盒
 /// @param box0
 /// @param box1
 /// @return
-aabb surrounding_box(aabb box0, aabb box1)
+template <typename T>
+basic_aabb<T> surrounding_box(basic_aabb<T> box0, basic_aabb<T> box1)
 {
-    vec3 small(ffmin(box0.min().x(), box1.min().x()), ffmin(box0.min().y(), box1.min().y()), ffmin(box0.min().z(), box1.min().z()));
-    vec3 big(ffmax(box0.max().x(), box1.max().x()), ffmax(box0.max().y(), box1.max().y()), ffmax(box0.max().z(), box1.max().z()));
-    return aabb(small, big);
+    basic_vec3<T> small(ffmin(box0.min().x(), box1.min().x()), ffmin(box0.min().y(), box1.min().y()), ffmin(box0.min().z(), box1.min().z()));
+    basic_vec3<T> big(ffmax(box0.max().x(), box1.max().x()), ffmax(box0.max().y(), box1.max().y()), ffmax(box0.max().z(), box1.max().z()));
+    return basic_aabb<T>(small, big);
 }
\ No newline at end of file
@@ -0,0 +1,181 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+/// @brief 单调（bump）分配器，场景中的图元、BVH节点等对象都从这里分配，生命周期与arena相同
+/// 对象按分配顺序连续存放在大块内存中，分配只移动一个指针，没有引用计数；
+/// 销毁时只对析构函数不平凡的对象调用析构函数（逆序），然后一次释放所有的块
+class arena
+{
+public:
+    /// @param block_size 每次向系统申请的块大小，大于块的四分之一的对象单独分配一块
+    explicit arena(size_t block_size = 64 * 1024) noexcept
+        : _block_size(block_size)
+    {
+    }
+
+    arena(const arena&)            = delete;
+    arena& operator=(const arena&) = delete;
+
+    arena(arena&& other) noexcept
+        : _block_size(other._block_size)
+        , _blocks(std::exchange(other._blocks, nullptr))
+        , _finalizers(std::exchange(other._finalizers, nullptr))
+        , _current(std::exchange(other._current, nullptr))
+        , _end(std::exchange(other._end, nullptr))
+        , _bytes_used(std::exchange(other._bytes_used, 0))
+        , _bytes_reserved(std::exchange(other._bytes_reserved, 0))
+    {
+    }
+
+    arena& operator=(arena&& other) noexcept
+    {
+        if (this != &other)
+        {
+            release();
+            _block_size     = other._block_size;
+            _blocks         = std::exchange(other._blocks, nullptr);
+            _finalizers     = std::exchange(other._finalizers, nullptr);
+            _current        = std::exchange(other._current, nullptr);
+            _end            = std::exchange(other._end, nullptr);
+            _bytes_used     = std::exchange(other._bytes_used, 0);
+            _bytes_reserved = std::exchange(other._bytes_reserved, 0);
+        }
+        return *this;
+    }
+
+    ~arena() noexcept
+    {
+        release();
+    }
+
+    /// @brief 在arena中构造一个T，返回的指针在arena销毁或release之前一直有效
+    template <typename T, typename... Args>
+    T* make(Args&&... args)
+    {
+        if constexpr (std::is_trivially_destructible_v<T>)
+        {
+            return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+        }
+        else
+        {
+            // 先分配析构记录，构造对象之后不会再因为分配失败而泄漏
+            auto record     = static_cast<finalizer*>(allocate(sizeof(finalizer), alignof(finalizer)));
+            T* object       = new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+            record->object  = object;
+            record->destroy = [](void* p) noexcept { static_cast<T*>(p)->~T(); };
+            record->next    = _finalizers;
+            _finalizers     = record;
+            return object;
+        }
+    }
+
+    /// @brief 分配size字节未初始化的内存
+    void* allocate(size_t size, size_t alignment = alignof(std::max_align_t))
+    {
+        auto p = align_up(_current, alignment);
+        if (_current == nullptr || p + size > _end)
+        {
+            if (size + alignment > _block_size / 4)
+            {
+                // 大对象单独分配一块，不浪费当前块剩余的空间
+                _bytes_used += size;
+                return align_up(add_block(size + alignment, false), alignment);
+            }
+            p = align_up(add_block(_block_size, true), alignment);
+        }
+
+        _current = p + size;
+        _bytes_used += size;
+        return p;
+    }
+
+    /// @brief 析构所有对象并释放所有的块，之后可以继续分配
+    void release() noexcept
+    {
+        for (auto f = _finalizers; f != nullptr; f = f->next)
+        {
+            f->destroy(f->object);
+        }
+        _finalizers = nullptr;
+
+        while (_blocks != nullptr)
+        {
+            auto next = _blocks->next;
+            ::operator delete(static_cast<void*>(_blocks));
+            _blocks = next;
+        }
+        _current        = nullptr;
+        _end            = nullptr;
+        _bytes_used     = 0;
+        _bytes_reserved = 0;
+    }
+
+    /// @brief 已经分配给对象的字节数
+    size_t bytes_used() const noexcept
+    {
+        return _bytes_used;
+    }
+
+    /// @brief 向系统申请的字节数
+    size_t bytes_reserved() const noexcept
+    {
+        return _bytes_reserved;
+    }
+
+private:
+    /// @brief 每块内存的开头，所有的块连成一个链表
+    struct block_header
+    {
+        block_header* next;
+    };
+
+    /// @brief 析构函数不平凡的对象的析构记录，也分配在arena中
+    struct finalizer
+    {
+        void* object;
+        void (*destroy)(void*) noexcept;
+        finalizer* next;
+    };
+
+    static std::byte* align_up(std::byte* p, size_t alignment) noexcept
+    {
+        const auto address = reinterpret_cast<uintptr_t>(p);
+        return p + ((alignment - address % alignment) % alignment);
+    }
+
+    /// @brief 申请一块至少size字节的内存
+    /// @param current 是否作为当前块继续分配，单独分配的大对象不替换当前块
+    /// @return 可用空间的起始地址
+    std::byte* add_block(size_t size, bool current)
+    {
+        const size_t header = (sizeof(block_header) + alignof(std::max_align_t) - 1) / alignof(std::max_align_t) * alignof(std::max_align_t);
+        auto memory         = static_cast<std::byte*>(::operator new(header + size));
+
+        auto block  = reinterpret_cast<block_header*>(memory);
+        block->next = _blocks;
+        _blocks     = block;
+        _bytes_reserved += header + size;
+
+        if (current)
+        {
+            _current = memory + header;
+            _end     = memory + header + size;
+        }
+        return memory + header;
+    }
+
+    size_t _block_size;
+    block_header* _blocks { nullptr };
+    finalizer* _finalizers { nullptr };
+    std::byte* _current { nullptr };
+    std::byte* _end { nullptr };
+    size_t _bytes_used { 0 };
+    size_t _bytes_reserved { 0 };
+};
@@ -0,0 +1,272 @@
+#include "framebuffer.hpp"
+#include "hittable_list.hpp"
+#include "integrator.hpp"
+#include "packet.hpp"
+#include "renderer.hpp"
+#include "rtweekend.hpp"
+#include "scenes.hpp"
+#include "simd.hpp"
+#include "stats.hpp"
+#include "wavefront.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+/// @brief 计时，结果以毫秒为单位，精度与steady_clock相同
+class stopwatch
+{
+public:
+    double elapsed_ms() const noexcept
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - _start).count();
+    }
+
+private:
+    std::chrono::steady_clock::time_point _start { std::chrono::steady_clock::now() };
+};
+
+/// @brief 统计场景的求交次数（即追踪的光线数）
+/// 每个线程先累加到自己的计数器，线程退出时合并到总数，渲染函数返回时线程池已经销毁，总数是完整的
+class counting_hittable : public hittable
+{
+public:
+    explicit counting_hittable(const hittable& inner) noexcept
+        : _inner(inner)
+    {
+    }
+
+    virtual bool hit(const ray& r, real t_min, real t_max, hit_record& rec) const override
+    {
+        ++local().count;
+        return _inner.hit(r, t_min, t_max, rec);
+    }
+
+    virtual bool occluded(const ray& r, real t_min, real t_max) const override
+    {
+        ++local().count;
+        return _inner.occluded(r, t_min, t_max);
+    }
+
+    virtual bool bounding_box(real t0, real t1, aabb& output_box) const override
+    {
+        return _inner.bounding_box(t0, t1, output_box);
+    }
+
+    static uint64_t total() noexcept
+    {
+        return _total.load();
+    }
+
+    static void reset() noexcept
+    {
+        _total.store(0);
+    }
+
+private:
+    struct counter
+    {
+        uint64_t count { 0 };
+
+        ~counter()
+        {
+            _total.fetch_add(count, std::memory_order_relaxed);
+        }
+    };
+
+    static counter& local() noexcept
+    {
+        thread_local counter c;
+        return c;
+    }
+
+    static inline std::atomic<uint64_t> _total { 0 };
+
+    const hittable& _inner;
+};
+
+/// @brief 一个测试场景，场景函数在固定的随机数种子下调用
+struct bench_case
+{
+    std::string name;
+    std::function<scene()> make;
+};
+
+/// @brief 一次渲染的结果
+struct bench_run
+{
+    std::string integrator;
+    double render_ms { 0 };
+    double encode_ms { 0 };
+    uint64_t primary_rays { 0 };
+    uint64_t secondary_rays { 0 };
+    render_stats counters; // 打开RT_ENABLE_STATS时有效
+};
+
+int main(int argc, char* argv[])
+{
+    // 所有场景使用相同的设置，结果只取决于代码和机器
+    const int image_width       = 200;
+    const int image_height      = 100;
+    const int samples_per_pixel = 16;
+    const int max_depth         = 50;
+    const int roulette_depth    = 3;
+    const uint64_t seed         = 0;
+
+    const std::vector<bench_case> cases {
+        { "in_one_weekend", [] { return in_one_weekend_scene(); } },
+        { "the_next_week", [] { return the_next_week_scene(); } },
+        { "spheres_10k", [] { return sphere_field_scene(10'000); } },
+        { "spheres_100k", [] { return sphere_field_scene(100'000); } },
+        { "spheres_1m", [] { return sphere_field_scene(1'000'000); } },
+    };
+
+    // 参数：--output=路径 把JSON写入文件，其他参数是要运行的场景名，没有时运行所有场景
+    std::string output;
+    std::vector<std::string> selected;
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string_view arg(argv[i]);
+        if (arg.starts_with("--output="))
+        {
+            output = arg.substr(9);
+        }
+        else
+        {
+            selected.emplace_back(arg);
+        }
+    }
+
+    render_settings settings;
+    settings.image_width       = image_width;
+    settings.image_height      = image_height;
+    settings.samples_per_pixel = samples_per_pixel;
+    settings.seed              = seed;
+
+    std::ostringstream json;
+    json << "{\n";
+    json << "  \"config\": {\"scalar\": \"" << (sizeof(real) == sizeof(float) ? "float" : "double") << "\", \"simd_level\": " << RT_SIMD_LEVEL
+         << ", \"threads\": " << std::max(1u, std::thread::hardware_concurrency()) << ", \"width\": " << image_width << ", \"height\": " << image_height
+         << ", \"samples_per_pixel\": " << samples_per_pixel << ", \"max_depth\": " << max_depth << ", \"roulette_depth\": " << roulette_depth
+         << ", \"seed\": " << seed << "},\n";
+    json << "  \"scenes\": [";
+
+    bool first_case = true;
+    for (const auto& c : cases)
+    {
+        if (!selected.empty() && std::find(selected.begin(), selected.end(), c.name) == selected.end())
+        {
+            continue;
+        }
+        std::cerr << "\n" << c.name << '\n';
+
+        seed_random(seed);
+        stopwatch scene_timer;
+        auto s                = c.make();
+        const double scene_ms = scene_timer.elapsed_ms();
+
+        stopwatch build_timer;
+        s.build();
+        const double build_ms = build_timer.elapsed_ms();
+
+        const hittable_list world = s.world();
+        const counting_hittable counted(world);
+        const camera cam = s.make_camera(double(image_width) / image_height);
+
+        std::vector<bench_run> runs;
+        for (auto mode : { integrator_mode::recursive, integrator_mode::iterative, integrator_mode::wavefront, integrator_mode::packet })
+        {
+            constexpr const char* names[] = { "recursive", "wavefront", "packet", "iterative" };
+
+            bench_run run;
+            run.integrator = names[static_cast<size_t>(mode)];
+
+            counting_hittable::reset();
+            stats::begin_frame(image_width, image_height);
+            stopwatch render_timer;
+            framebuffer image;
+            if (mode == integrator_mode::recursive)
+            {
+                image = render_tiles(settings, [&](double u, double v, sampler& samples) { return ray_color(cam.get_ray(u, v, samples), counted, s.materials, s.lights, max_depth); });
+            }
+            else if (mode == integrator_mode::iterative)
+            {
+                image = render_tiles(settings, [&](double u, double v, sampler& samples) {
+                    return path_color(cam.get_ray(u, v, samples), counted, s.materials, s.lights, max_depth, roulette_depth, samples);
+                });
+            }
+            else if (mode == integrator_mode::wavefront)
+            {
+                image = render_wavefront(settings, cam, counted, s.materials, max_depth);
+            }
+            else
+            {
+                image = render_packets(settings, cam, *s.spheres, s.surfaces(), counted, s.materials, s.lights, max_depth);
+            }
+            run.render_ms = render_timer.elapsed_ms();
+            run.counters  = stats::frame();
+
+            const uint64_t rays = counting_hittable::total();
+            run.primary_rays    = static_cast<uint64_t>(image_width) * image_height * samples_per_pixel;
+            // packet的主光线直接由sphere_soa求交，不经过counted
+            run.secondary_rays = mode == integrator_mode::packet ? rays : rays - run.primary_rays;
+
+            stopwatch encode_timer;
+            std::ostringstream encoded;
+            image.write(encoded, image_format::png);
+            run.encode_ms = encode_timer.elapsed_ms();
+
+            runs.push_back(run);
+        }
+
+        json << (first_case ? "\n" : ",\n");
+        first_case = false;
+        json << "    {\"name\": \"" << c.name << "\", \"spheres\": " << s.spheres->size() << ", \"bvh_nodes\": " << s.spheres->node_count()
+             << ", \"scene_ms\": " << scene_ms << ", \"bvh_build_ms\": " << build_ms << ", \"runs\": [";
+        for (size_t i = 0; i < runs.size(); ++i)
+        {
+            const auto& run   = runs[i];
+            const auto rays   = run.primary_rays + run.secondary_rays;
+            const double rate = run.render_ms > 0 ? rays / (run.render_ms / 1000) : 0.0;
+            json << (i == 0 ? "\n" : ",\n");
+            json << "      {\"integrator\": \"" << run.integrator << "\", \"render_ms\": " << run.render_ms << ", \"encode_ms\": " << run.encode_ms
+                 << ", \"primary_rays\": " << run.primary_rays << ", \"secondary_rays\": " << run.secondary_rays << ", \"rays_per_second\": " << rate;
+            if constexpr (stats::enabled)
+            {
+                const auto& st = run.counters;
+                const auto n   = std::max<uint64_t>(1, st.rays());
+                json << ", \"stats\": {\"hit_ratio\": " << double(st.hits) / n << ", \"node_visits_per_ray\": " << double(st.node_visits) / n
+                     << ", \"box_tests_per_ray\": " << double(st.box_tests) / n << ", \"primitive_tests_per_ray\": " << double(st.primitive_tests) / n
+                     << ", \"escaped\": " << st.path_ends[0] << ", \"absorbed\": " << st.path_ends[1] << ", \"depth_limit\": " << st.path_ends[2]
+                     << ", \"roulette\": " << st.path_ends[3] << "}";
+            }
+            json << "}";
+        }
+        json << "\n    ]}";
+    }
+    json << "\n  ]\n}\n";
+
+    std::cerr << '\n';
+    if (output.empty())
+    {
+        std::cout << json.str();
+        return 0;
+    }
+
+    std::ofstream file(output);
+    file << json.str();
+    if (!file)
+    {
+        std::cerr << "Failed to write " << output << '\n';
+        return 1;
+    }
+    return 0;
+}
@@ -1,8 +1,11 @@
 #pragma once
 
+#include "arena.hpp"
 #include "hittable_list.hpp"
 
-inline bool box_compare(const shared_ptr<hittable> a, const shared_ptr<hittable> b, int axis)
+#include <algorithm>
+
+inline bool box_compare(const hittable* a, const hittable* b, int axis)
 {
     aabb box_a {};
     aabb box_b {};
@@ -15,17 +18,17 @@ inline bool box_compare(const shared_ptr<hittable> a, const shared_ptr<hittable>
     return box_a.min().e()[axis] < box_b.min().e()[axis];
 }
 
-bool box_x_compare(const shared_ptr<hittable> a, const shared_ptr<hittable> b)
+inline bool box_x_compare(const hittable* a, const hittable* b)
 {
     return box_compare(a, b, 0);
 }
 
-bool box_y_compare(const shared_ptr<hittable> a, const shared_ptr<hittable> b)
+inline bool box_y_compare(const hittable* a, const hittable* b)
 {
     return box_compare(a, b, 1);
 }
 
-bool box_z_compare(const shared_ptr<hittable> a, const shared_ptr<hittable> b)
+inline bool box_z_compare(const hittable* a, const hittable* b)
 {
     return box_compare(a, b, 2);
 }
@@ -37,12 +40,20 @@ public:
     {
     }
 
-    bvh_node(hittable_list& list, double time0, double time1)
-        : bvh_node(list.objects(), 0, list.objects().size(), time0, time1)
+    /// @brief 所有的子节点都分配在storage中，storage的生命周期必须长于这棵树，通常就是场景的arena
+    bvh_node(arena& storage, const hittable_list& list, real time0, real time1)
+        : bvh_node(storage, std::vector<const hittable*>(list.objects()), time0, time1)
+    {
+    }
+
+    /// @brief 只在构建开始时复制一次图元列表，之后每个节点都在这个列表上原地排序
+    bvh_node(arena& storage, std::vector<const hittable*>&& objects, real time0, real time1)
+        : bvh_node(storage, objects, 0, objects.size(), time0, time1)
     {
     }
 
-    bvh_node(const std::vector<shared_ptr<hittable>>& objects, size_t start, size_t end, double time0, double time1)
+    /// @brief 用objects[start, end)构建节点，会原地重排这个范围内的图元
+    bvh_node(arena& storage, std::vector<const hittable*>& objects, size_t start, size_t end, real time0, real time1)
     {
         int axis           = random_int(0, 2);
         auto comparator    = (axis == 0) ? box_x_compare : (axis == 1) ? box_y_compare : box_z_compare;
@@ -67,12 +78,12 @@ public:
         }
         else
         {
-            std::vector<shared_ptr<hittable>> temp_objects = objects;
-            std::sort(temp_objects.begin() + start, temp_objects.begin() + end, comparator);
-
+            // 只需要保证中位数两侧分开，不需要完全排序
             auto mid = start + object_span / 2;
-            _left     = make_shared<bvh_node>(temp_objects, start, mid, time0, time1);
-            _right    = make_shared<bvh_node>(temp_objects, mid, end, time0, time1);
+            std::nth_element(objects.begin() + start, objects.begin() + mid, objects.begin() + end, comparator);
+
+            _left  = storage.make<bvh_node>(storage, objects, start, mid, time0, time1);
+            _right = storage.make<bvh_node>(storage, objects, mid, end, time0, time1);
         }
 
         aabb box_left, box_right;
@@ -85,27 +96,37 @@ public:
         _box = surrounding_box(box_left, box_right);
     }
 
-    virtual bool hit(const ray& r, double tmin, double tmax, hit_record& rec) const override
+    virtual bool hit(const ray& r, real tmin, real tmax, hit_record& rec) const override
     {
+        stats::count_node_visit();
+
         if (!_box.hit(r, tmin, tmax))
         {
             return false;
         }
 
+        // 左孩子命中后只需要在更近的范围内查找右孩子，否则更远的交点会覆盖rec
         bool hit_left  = _left->hit(r, tmin, tmax, rec);
-        bool hit_right = _right->hit(r, tmin, tmax, rec);
+        bool hit_right = _right->hit(r, tmin, hit_left ? rec.t : tmax, rec);
 
         return hit_left || hit_right;
     }
 
-    virtual bool bounding_box(double t0, double t1, aabb& output_box) const override
+    virtual bool occluded(const ray& r, real tmin, real tmax) const override
+    {
+        stats::count_node_visit();
+
+        return _box.hit(r, tmin, tmax) && (_left->occluded(r, tmin, tmax) || _right->occluded(r, tmin, tmax));
+    }
+
+    virtual bool bounding_box(real t0, real t1, aabb& output_box) const override
     {
         output_box = _box;
         return true;
     }
 
 private:
-    shared_ptr<hittable> _left;
-    shared_ptr<hittable> _right;
+    const hittable* _left { nullptr };
+    const hittable* _right { nullptr };
     aabb _box;
 };
\ No newline at end of file
@@ -0,0 +1,600 @@
+#pragma once
+
+#include "aabb.hpp"
+#include "rtweekend.hpp"
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <vector>
+
+/// @brief 线性存储的BVH节点，32字节，两个节点正好占一条64字节的缓存行
+/// 包围盒使用float存储，构建时向外取整，保证不会漏掉相交
+struct flat_bvh_node
+{
+    float bounds_min[3];
+    float bounds_max[3];
+    uint32_t offset; // 内部节点：右孩子的下标（左孩子紧跟在当前节点之后）；叶子：第一个图元的下标
+    uint16_t count;  // 叶子中图元的数量，为0表示内部节点
+    uint16_t axis;   // 内部节点的划分轴
+
+    bool is_leaf() const noexcept
+    {
+        return count != 0;
+    }
+};
+
+static_assert(sizeof(flat_bvh_node) == 32, "flat_bvh_node must be 32 bytes");
+
+/// @brief BVH的最大深度，也是遍历栈的大小
+constexpr size_t bvh_max_depth = 64;
+
+/// @brief 一个叶子最多的图元数，受flat_bvh_node::count的位数限制
+constexpr size_t bvh_max_leaf_count = std::numeric_limits<uint16_t>::max();
+
+inline aabb node_box(const flat_bvh_node& node) noexcept
+{
+    return aabb(vec3(node.bounds_min[0], node.bounds_min[1], node.bounds_min[2]), vec3(node.bounds_max[0], node.bounds_max[1], node.bounds_max[2]));
+}
+
+inline void set_node_bounds(flat_bvh_node& node, const aabb& box) noexcept
+{
+    for (size_t i = 0; i < 3; ++i)
+    {
+        // 向外取整，float包围盒一定包含原来的double包围盒
+        node.bounds_min[i] = std::nextafter(static_cast<float>(box.min()[i]), -std::numeric_limits<float>::infinity());
+        node.bounds_max[i] = std::nextafter(static_cast<float>(box.max()[i]), std::numeric_limits<float>::infinity());
+    }
+}
+
+/// @brief 运动模糊BVH的节点，分别保存快门打开和关闭时刻的包围盒
+/// 图元在快门时间内线性运动时，t时刻的包围盒就是两个包围盒按时间的线性插值，遍历时按光线的时刻插值，
+/// 比两个时刻包围盒的并集小得多；树的结构和offset、count、axis的含义与flat_bvh_node相同
+struct motion_bvh_node
+{
+    float bounds0_min[3]; // 快门打开时刻
+    float bounds0_max[3];
+    float bounds1_min[3]; // 快门关闭时刻
+    float bounds1_max[3];
+    uint32_t offset;
+    uint16_t count;
+    uint16_t axis;
+
+    bool is_leaf() const noexcept
+    {
+        return count != 0;
+    }
+};
+
+static_assert(sizeof(motion_bvh_node) == 56, "motion_bvh_node must be 56 bytes");
+
+/// @brief 快门时间内u（0到1）处的包围盒
+inline aabb node_box(const motion_bvh_node& node, double u) noexcept
+{
+    vec3 lo, hi;
+    for (size_t i = 0; i < 3; ++i)
+    {
+        lo[i] = node.bounds0_min[i] + u * (node.bounds1_min[i] - node.bounds0_min[i]);
+        hi[i] = node.bounds0_max[i] + u * (node.bounds1_max[i] - node.bounds0_max[i]);
+    }
+    return aabb(lo, hi);
+}
+
+inline void set_node_bounds(motion_bvh_node& node, const aabb& box0, const aabb& box1) noexcept
+{
+    flat_bvh_node n0 {}, n1 {};
+    set_node_bounds(n0, box0);
+    set_node_bounds(n1, box1);
+    for (size_t i = 0; i < 3; ++i)
+    {
+        node.bounds0_min[i] = n0.bounds_min[i];
+        node.bounds0_max[i] = n0.bounds_max[i];
+        node.bounds1_min[i] = n1.bounds_min[i];
+        node.bounds1_max[i] = n1.bounds_max[i];
+    }
+}
+
+/// @brief BVH节点的划分方式
+enum class bvh_split_method
+{
+    median, // 沿中心点分布最长的轴在中位数处划分
+    sah,    // 分桶的表面积启发式（binned SAH），按代价选择划分轴和划分位置
+    lbvh,   // 按中心点的Morton码排序后按最高不同位划分，构建最快，树的质量不如SAH
+};
+
+/// @brief BVH构建参数
+struct bvh_build_options
+{
+    bvh_split_method split_method { bvh_split_method::sah };
+    size_t bin_count { 16 };             // SAH每个轴上的桶数
+    size_t max_leaf_size { 4 };          // 叶子最多包含的图元数
+    double traversal_cost { 1.0 };       // 访问一个内部节点的代价
+    double intersection_cost { 1.0 };    // 与一个图元求交的代价
+    size_t thread_count { 0 };           // 构建使用的线程数，为0时使用硬件线程数
+    size_t parallel_threshold { 4096 };  // 图元数少于这个值时只用一个线程构建
+};
+
+/// @brief 构建结果：节点数组以及叶子引用的图元顺序
+/// 叶子的offset是primitive_indices中的下标，primitive_indices保存的是输入包围盒的下标
+struct bvh_build_result
+{
+    std::vector<flat_bvh_node> nodes;
+    std::vector<uint32_t> primitive_indices;
+};
+
+/// @brief 整棵树的SAH代价：内部节点按访问概率（表面积之比）累加遍历代价，叶子累加求交代价
+/// 代价越小，平均每条光线需要的节点访问和求交次数越少，可以用来比较不同的构建方式
+inline double bvh_sah_cost(std::span<const flat_bvh_node> nodes, const bvh_build_options& options) noexcept
+{
+    if (nodes.empty())
+    {
+        return 0.0;
+    }
+
+    const double root_area = node_box(nodes[0]).surface_area();
+    if (root_area <= 0)
+    {
+        return 0.0;
+    }
+
+    double cost = 0.0;
+    for (const auto& node : nodes)
+    {
+        const double probability = node_box(node).surface_area() / root_area;
+        cost += node.is_leaf() ? probability * node.count * options.intersection_cost : probability * options.traversal_cost;
+    }
+    return cost;
+}
+
+/// @brief 运动模糊BVH的SAH代价，表面积取快门中间时刻的包围盒
+inline double bvh_sah_cost(std::span<const motion_bvh_node> nodes, const bvh_build_options& options) noexcept
+{
+    if (nodes.empty())
+    {
+        return 0.0;
+    }
+
+    const double root_area = node_box(nodes[0], 0.5).surface_area();
+    if (root_area <= 0)
+    {
+        return 0.0;
+    }
+
+    double cost = 0.0;
+    for (const auto& node : nodes)
+    {
+        const double probability = node_box(node, 0.5).surface_area() / root_area;
+        cost += node.is_leaf() ? probability * node.count * options.intersection_cost : probability * options.traversal_cost;
+    }
+    return cost;
+}
+
+/// @brief 基于下标的BVH构建器
+/// 只在一个图元引用数组上原地划分，每层的工作量与图元数成正比，总复杂度O(n log n)
+/// 图元较多时先串行划分出上层节点，再把下层的子树作为任务交给线程池并行构建，最后拼接成一个数组，
+/// 结果与单线程构建完全相同
+class bvh_builder
+{
+public:
+    explicit bvh_builder(const bvh_build_options& options = {}) noexcept
+        : _options(options)
+    {
+    }
+
+    /// @brief 为一组图元的包围盒构建BVH
+    bvh_build_result build(const std::vector<aabb>& boxes) const
+    {
+        bvh_build_result result;
+        if (boxes.empty())
+        {
+            return result;
+        }
+
+        std::vector<build_ref> refs(boxes.size());
+        for (size_t i = 0; i < boxes.size(); ++i)
+        {
+            refs[i] = { boxes[i], 0.5 * (boxes[i].min() + boxes[i].max()), static_cast<uint32_t>(i), 0 };
+        }
+
+        if (_options.split_method == bvh_split_method::lbvh)
+        {
+            sort_by_morton_code(refs);
+        }
+
+        const size_t thread_count = _options.thread_count == 0 ? std::max(1u, std::thread::hardware_concurrency()) : _options.thread_count;
+        if (thread_count > 1 && refs.size() > _options.parallel_threshold)
+        {
+            result.nodes = build_parallel(refs, thread_count);
+        }
+        else
+        {
+            result.nodes.reserve(2 * refs.size() / std::max<size_t>(1, _options.max_leaf_size) + 1);
+            build_range(result.nodes, refs, 0, refs.size(), 0, nullptr);
+        }
+
+        result.primitive_indices.resize(refs.size());
+        for (size_t i = 0; i < refs.size(); ++i)
+        {
+            result.primitive_indices[i] = refs[i].index;
+        }
+        return result;
+    }
+
+private:
+    struct build_ref
+    {
+        aabb box;
+        vec3 centroid;
+        uint32_t index;
+        uint32_t morton;
+    };
+
+    /// @brief 并行构建时留给线程池的子树
+    struct subtree_job
+    {
+        size_t start, end, depth;
+        std::vector<flat_bvh_node> nodes;
+    };
+
+    struct job_list
+    {
+        size_t grain;                        // 图元数不超过grain的子树交给线程池
+        std::vector<subtree_job> jobs;
+        std::vector<uint32_t> job_of_node;   // 上层节点对应的子树任务，没有则为max
+    };
+
+    std::vector<flat_bvh_node> build_parallel(std::vector<build_ref>& refs, size_t thread_count) const
+    {
+        job_list list;
+        list.grain = std::max(_options.parallel_threshold / 4, refs.size() / (thread_count * 8));
+
+        std::vector<flat_bvh_node> top;
+        build_range(top, refs, 0, refs.size(), 0, &list);
+
+        {
+            // 各个子树的图元范围互不重叠，可以同时原地划分
+            thread_pool pool(thread_count);
+            for (auto& job : list.jobs)
+            {
+                pool.submit([this, &refs, &job] {
+                    job.nodes.reserve(2 * (job.end - job.start));
+                    build_range(job.nodes, refs, job.start, job.end, job.depth, nullptr);
+                });
+            }
+            pool.wait();
+        }
+
+        std::vector<flat_bvh_node> nodes;
+        nodes.reserve(2 * refs.size());
+        splice(top, list, 0, nodes);
+        return nodes;
+    }
+
+    /// @brief 按深度优先顺序把上层节点和子树拼接到nodes中，返回top_index在nodes中的下标
+    static uint32_t splice(const std::vector<flat_bvh_node>& top, const job_list& list, uint32_t top_index, std::vector<flat_bvh_node>& nodes)
+    {
+        const auto index = static_cast<uint32_t>(nodes.size());
+
+        const auto job = list.job_of_node[top_index];
+        if (job != std::numeric_limits<uint32_t>::max())
+        {
+            // 子树内部节点的右孩子下标需要加上子树在数组中的起点
+            for (auto node : list.jobs[job].nodes)
+            {
+                if (!node.is_leaf())
+                {
+                    node.offset += index;
+                }
+                nodes.push_back(node);
+            }
+            return index;
+        }
+
+        nodes.push_back(top[top_index]);
+        if (!top[top_index].is_leaf())
+        {
+            splice(top, list, top_index + 1, nodes);
+            nodes[index].offset = splice(top, list, top[top_index].offset, nodes);
+        }
+        return index;
+    }
+
+    /// @brief 递归构建[start, end)范围内的图元，返回节点在nodes中的下标
+    /// 节点按深度优先顺序存储，左孩子紧跟在父节点之后
+    /// jobs不为空时，图元数不超过jobs->grain的子树只生成一个占位节点，留给线程池构建
+    uint32_t build_range(std::vector<flat_bvh_node>& nodes, std::vector<build_ref>& refs, size_t start, size_t end, size_t depth,
+        job_list* jobs) const
+    {
+        const auto node_index = static_cast<uint32_t>(nodes.size());
+        nodes.emplace_back();
+
+        const size_t count = end - start;
+        if (jobs != nullptr)
+        {
+            jobs->job_of_node.push_back(std::numeric_limits<uint32_t>::max());
+            if (count <= jobs->grain)
+            {
+                jobs->job_of_node[node_index] = static_cast<uint32_t>(jobs->jobs.size());
+                jobs->jobs.push_back({ start, end, depth, {} });
+                return node_index;
+            }
+        }
+
+        aabb bounds = refs[start].box;
+        aabb centroid_bounds(refs[start].centroid, refs[start].centroid);
+        for (size_t i = start + 1; i < end; ++i)
+        {
+            bounds          = surrounding_box(bounds, refs[i].box);
+            centroid_bounds = surrounding_box(centroid_bounds, aabb(refs[i].centroid, refs[i].centroid));
+        }
+        set_node_bounds(nodes[node_index], bounds);
+
+        const auto extent = centroid_bounds.max() - centroid_bounds.min();
+
+        // 中心点重合时无法再划分
+        const bool degenerate = extent.x() <= 0 && extent.y() <= 0 && extent.z() <= 0;
+
+        // 图元数超过bvh_max_leaf_count时不能做成一个叶子，至少还要对半划分halvings层；
+        // 中心点重合或者剩下的深度刚好只够对半划分时按数量对半划分，保证叶子的图元数和深度都不超过上限
+        const size_t halvings = count > bvh_max_leaf_count ? std::bit_width((count - 1) / bvh_max_leaf_count) : 0;
+        const bool halve      = halvings > 0 && (degenerate || depth + halvings + 1 >= bvh_max_depth);
+        if (!halve && (count == 1 || degenerate || depth + 1 >= bvh_max_depth))
+        {
+            make_leaf(nodes[node_index], start, end);
+            return node_index;
+        }
+
+        int axis   = 0;
+        size_t mid = start;
+        if (halve)
+        {
+            // LBVH的范围已经按Morton码排好序，直接按数量对半划分，不打乱下面划分需要的顺序
+            axis = longest_axis(extent);
+            mid  = _options.split_method == bvh_split_method::lbvh ? start + count / 2 : split_median(refs, start, end, axis);
+        }
+        else
+        {
+            switch (_options.split_method)
+            {
+            case bvh_split_method::sah:
+                // 叶子代价更低时不再划分
+                if (!split_sah(refs, start, end, bounds, centroid_bounds, axis, mid))
+                {
+                    make_leaf(nodes[node_index], start, end);
+                    return node_index;
+                }
+                break;
+            case bvh_split_method::lbvh:
+                if (count <= _options.max_leaf_size && count <= bvh_max_leaf_count)
+                {
+                    make_leaf(nodes[node_index], start, end);
+                    return node_index;
+                }
+                split_morton(refs, start, end, centroid_bounds, axis, mid);
+                break;
+            default:
+                if (count <= _options.max_leaf_size && count <= bvh_max_leaf_count)
+                {
+                    make_leaf(nodes[node_index], start, end);
+                    return node_index;
+                }
+                axis = longest_axis(extent);
+                mid  = split_median(refs, start, end, axis);
+                break;
+            }
+        }
+
+        build_range(nodes, refs, start, mid, depth + 1, jobs);
+        const auto right = build_range(nodes, refs, mid, end, depth + 1, jobs);
+
+        auto& node  = nodes[node_index];
+        node.offset = right;
+        node.count  = 0;
+        node.axis   = static_cast<uint16_t>(axis);
+        return node_index;
+    }
+
+    static void make_leaf(flat_bvh_node& node, size_t start, size_t end) noexcept
+    {
+        // 划分是原地进行的，叶子的图元就是引用数组中连续的一段
+        node.offset = static_cast<uint32_t>(start);
+        node.count  = static_cast<uint16_t>(end - start);
+        node.axis   = 0;
+    }
+
+    static int longest_axis(const vec3& extent) noexcept
+    {
+        int axis = 0;
+        if (extent.y() > extent.x())
+            axis = 1;
+        if (extent.z() > extent[axis])
+            axis = 2;
+        return axis;
+    }
+
+    /// @brief 沿axis在中位数处划分，返回右半部分的起点
+    static size_t split_median(std::vector<build_ref>& refs, size_t start, size_t end, int axis)
+    {
+        const size_t mid = start + (end - start) / 2;
+        std::nth_element(refs.begin() + start, refs.begin() + mid, refs.begin() + end,
+            [axis](const build_ref& a, const build_ref& b) { return a.centroid[axis] < b.centroid[axis]; });
+        return mid;
+    }
+
+    /// @brief 分桶SAH：把中心点按每个轴分到bin_count个桶中，在桶的边界上选代价最小的划分
+    /// @return 划分比做成叶子更划算（或者图元太多必须划分）时返回true，axis和mid为划分结果
+    bool split_sah(std::vector<build_ref>& refs, size_t start, size_t end, const aabb& bounds, const aabb& centroid_bounds, int& axis,
+        size_t& mid) const
+    {
+        struct bin
+        {
+            aabb box;
+            size_t count { 0 };
+        };
+
+        const size_t count     = end - start;
+        const size_t bin_count = std::max<size_t>(2, _options.bin_count);
+        const double area      = bounds.surface_area();
+
+        double best_cost  = infinity;
+        int best_axis     = -1;
+        size_t best_split = 0;
+
+        std::vector<bin> bins(bin_count);
+        std::vector<double> right_area(bin_count);
+        std::vector<size_t> right_count(bin_count);
+
+        for (int a = 0; a < 3; ++a)
+        {
+            const double lo     = centroid_bounds.min()[a];
+            const double extent = centroid_bounds.max()[a] - lo;
+            if (extent <= 0)
+            {
+                continue;
+            }
+
+            std::fill(bins.begin(), bins.end(), bin {});
+            const double scale = bin_count / extent;
+            for (size_t i = start; i < end; ++i)
+            {
+                auto& b = bins[bin_index(refs[i].centroid[a], lo, scale, bin_count)];
+                b.box   = b.count == 0 ? refs[i].box : surrounding_box(b.box, refs[i].box);
+                ++b.count;
+            }
+
+            // 从右向左扫描，right_*[k]为桶[k, bin_count)的合并结果
+            aabb box {};
+            size_t n = 0;
+            for (size_t k = bin_count - 1; k > 0; --k)
+            {
+                if (bins[k].count > 0)
+                {
+                    box = n == 0 ? bins[k].box : surrounding_box(box, bins[k].box);
+                    n += bins[k].count;
+                }
+                right_area[k]  = n == 0 ? 0.0 : box.surface_area();
+                right_count[k] = n;
+            }
+
+            // 从左向右扫描，在桶k和k+1之间划分
+            n = 0;
+            for (size_t k = 0; k + 1 < bin_count; ++k)
+            {
+                if (bins[k].count > 0)
+                {
+                    box = n == 0 ? bins[k].box : surrounding_box(box, bins[k].box);
+                    n += bins[k].count;
+                }
+                if (n == 0 || right_count[k + 1] == 0)
+                {
+                    continue;
+                }
+
+                const double cost = _options.traversal_cost
+                    + _options.intersection_cost * (box.surface_area() * n + right_area[k + 1] * right_count[k + 1]) / area;
+                if (cost < best_cost)
+                {
+                    best_cost  = cost;
+                    best_axis  = a;
+                    best_split = k;
+                }
+            }
+        }
+
+        const double leaf_cost = _options.intersection_cost * count;
+        const bool must_split  = count > _options.max_leaf_size || count > bvh_max_leaf_count;
+        if (best_axis < 0 || (!must_split && leaf_cost <= best_cost))
+        {
+            if (!must_split)
+            {
+                return false;
+            }
+            // 所有中心点落在同一个桶里，退化为中位数划分
+            axis = longest_axis(centroid_bounds.max() - centroid_bounds.min());
+            mid  = split_median(refs, start, end, axis);
+            return true;
+        }
+
+        const double lo    = centroid_bounds.min()[best_axis];
+        const double scale = bin_count / (centroid_bounds.max()[best_axis] - lo);
+        auto it            = std::partition(refs.begin() + start, refs.begin() + end,
+                       [&](const build_ref& p) { return bin_index(p.centroid[best_axis], lo, scale, bin_count) <= best_split; });
+
+        axis = best_axis;
+        mid  = static_cast<size_t>(it - refs.begin());
+        return true;
+    }
+
+    static size_t bin_index(double centroid, double lo, double scale, size_t bin_count) noexcept
+    {
+        auto k = static_cast<size_t>((centroid - lo) * scale);
+        return std::min(k, bin_count - 1);
+    }
+
+    /// @brief 把10位整数的各位间隔两个0展开，用于交错生成30位Morton码
+    static uint32_t expand_bits(uint32_t v) noexcept
+    {
+        v = (v * 0x00010001u) & 0xFF0000FFu;
+        v = (v * 0x00000101u) & 0x0F00F00Fu;
+        v = (v * 0x00000011u) & 0xC30C30C3u;
+        v = (v * 0x00000005u) & 0x49249249u;
+        return v;
+    }
+
+    /// @brief 计算所有中心点的Morton码（x在最高位）并排序，空间上相邻的图元在数组中也相邻
+    static void sort_by_morton_code(std::vector<build_ref>& refs)
+    {
+        aabb centroid_bounds(refs[0].centroid, refs[0].centroid);
+        for (const auto& ref : refs)
+        {
+            centroid_bounds = surrounding_box(centroid_bounds, aabb(ref.centroid, ref.centroid));
+        }
+
+        const auto lo     = centroid_bounds.min();
+        const auto extent = centroid_bounds.max() - lo;
+        for (auto& ref : refs)
+        {
+            uint32_t code = 0;
+            for (int a = 0; a < 3; ++a)
+            {
+                const double x = extent[a] > 0 ? (ref.centroid[a] - lo[a]) / extent[a] : 0.0;
+                const auto q   = static_cast<uint32_t>(clamp(x * 1024.0, 0.0, 1023.0));
+                code |= expand_bits(q) << (2 - a);
+            }
+            ref.morton = code;
+        }
+
+        std::sort(refs.begin(), refs.end(), [](const build_ref& a, const build_ref& b) { return a.morton < b.morton || (a.morton == b.morton && a.index < b.index); });
+    }
+
+    /// @brief 在Morton码的最高不同位处划分（引用数组已经按Morton码排好序）
+    static void split_morton(const std::vector<build_ref>& refs, size_t start, size_t end, const aabb& centroid_bounds, int& axis, size_t& mid)
+    {
+        const uint32_t first = refs[start].morton;
+        const uint32_t last  = refs[end - 1].morton;
+
+        if (first == last)
+        {
+            // Morton码相同的图元没有空间顺序，直接对半分
+            axis = longest_axis(centroid_bounds.max() - centroid_bounds.min());
+            mid  = start + (end - start) / 2;
+            return;
+        }
+
+        // 最高不同位为bit，第一个该位为1的图元就是划分点
+        const int bit       = 31 - std::countl_zero(first ^ last);
+        const uint32_t mask = 1u << bit;
+        auto it = std::partition_point(refs.begin() + start, refs.begin() + end, [mask](const build_ref& r) { return (r.morton & mask) == 0; });
+
+        // x、y、z分别位于3k+2、3k+1、3k位
+        axis = 2 - bit % 3;
+        mid  = static_cast<size_t>(it - refs.begin());
+    }
+
+private:
+    bvh_build_options _options;
+};
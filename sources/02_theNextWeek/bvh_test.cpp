@@ -0,0 +1,114 @@
+#include "bvh_builder.hpp"
+#include "sphere_soa.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+// 叶子的图元数只有16位：超过65535个图元无法再划分（中心点重合）或者达到深度上限时，
+// 构建器仍然要把它们分到多个叶子中，每个图元恰好出现在一个叶子里，树的深度不超过遍历栈的大小
+
+namespace
+{
+    int failures = 0;
+
+    void check(bool condition, const char* what)
+    {
+        if (!condition)
+        {
+            std::cerr << "FAILED: " << what << '\n';
+            ++failures;
+        }
+    }
+
+    /// @brief 检查每个图元恰好被一个叶子引用，返回树的深度
+    size_t check_leaves(const bvh_build_result& result, size_t primitive_count, const char* what)
+    {
+        std::vector<int> seen(primitive_count, 0);
+        size_t max_depth = 0;
+
+        struct entry
+        {
+            uint32_t node;
+            size_t depth;
+        };
+        std::vector<entry> stack { { 0, 0 } };
+        while (!stack.empty())
+        {
+            const auto [index, depth] = stack.back();
+            stack.pop_back();
+            max_depth        = std::max(max_depth, depth);
+            const auto& node = result.nodes[index];
+            if (node.is_leaf())
+            {
+                for (uint32_t k = 0; k < node.count; ++k)
+                {
+                    ++seen[result.primitive_indices[node.offset + k]];
+                }
+                continue;
+            }
+            stack.push_back({ index + 1, depth + 1 });
+            stack.push_back({ node.offset, depth + 1 });
+        }
+
+        check(std::all_of(seen.begin(), seen.end(), [](int n) { return n == 1; }), what);
+        check(max_depth < bvh_max_depth, what);
+        return max_depth;
+    }
+} // namespace
+
+int main()
+{
+    constexpr size_t count = 3 * bvh_max_leaf_count + 7;
+
+    // 全部重合的包围盒，以及重合的一团加上一个远处的图元（根节点可以划分，之后退化）
+    std::vector<aabb> coincident(count, aabb(vec3(-1, -1, -1), vec3(1, 1, 1)));
+    std::vector<aabb> clustered = coincident;
+    clustered.push_back(aabb(vec3(99, 99, 99), vec3(101, 101, 101)));
+
+    // 互不重合的图元，但允许的叶子大小超过16位
+    std::vector<aabb> distinct(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        const vec3 c(static_cast<real>(i), 0, 0);
+        distinct[i] = aabb(c - vec3(0.25, 0.25, 0.25), c + vec3(0.25, 0.25, 0.25));
+    }
+
+    for (const auto method : { bvh_split_method::median, bvh_split_method::sah, bvh_split_method::lbvh })
+    {
+        for (const size_t threads : { size_t(1), size_t(4) })
+        {
+            bvh_build_options options;
+            options.split_method = method;
+            options.thread_count = threads;
+            check_leaves(bvh_builder(options).build(coincident), coincident.size(), "coincident boxes");
+            check_leaves(bvh_builder(options).build(clustered), clustered.size(), "clustered boxes");
+
+            options.max_leaf_size = 2 * count;
+            check_leaves(bvh_builder(options).build(distinct), distinct.size(), "leaf size above 16 bits");
+        }
+    }
+
+    // 重合的球全部可以被光线找到
+    sphere_soa spheres;
+    for (size_t i = 0; i < count; ++i)
+    {
+        spheres.add(vec3(0, 0, 0), 1, static_cast<uint32_t>(i));
+    }
+    spheres.build(0, 0);
+    size_t leaf_spheres = 0;
+    for (const auto& node : spheres.nodes())
+    {
+        leaf_spheres += node.is_leaf() ? node.count : 0;
+    }
+    check(leaf_spheres == count, "coincident spheres in sphere_soa");
+
+    hit_record rec;
+    check(spheres.hit(ray(vec3(0, 0, -5), vec3(0, 0, 1)), 0.001, infinity, rec) && rec.t > 3.99 && rec.t < 4.01, "hit coincident spheres");
+
+    if (failures == 0)
+    {
+        std::cout << "All BVH checks passed\n";
+    }
+    return failures == 0 ? 0 : 1;
+}
@@ -1,13 +1,69 @@
 #pragma once
 
 #include "rtweekend.hpp"
+#include "sampler.hpp"
+
+#include <cmath>
+#include <span>
+#include <string>
+
+/// @brief 视场角在(0, 180)度之间，否则视口退化
+inline bool valid_vfov(double vfov) noexcept
+{
+    return vfov > 0 && vfov < 180;
+}
+
+/// @brief 光圈为0时是针孔相机
+inline bool valid_aperture(double aperture) noexcept
+{
+    return aperture >= 0 && std::isfinite(aperture);
+}
+
+inline bool valid_focus_dist(double focus_dist) noexcept
+{
+    return focus_dist > 0 && std::isfinite(focus_dist);
+}
+
+/// @brief 检查相机参数能否构成相机的正交基：视线方向不为0，也不与vup平行，视场角等在合法范围内
+/// 命令行和场景文件的相机参数都用这个函数检查
+/// @param error 不合法时写入原因
+inline bool valid_camera(const vec3& lookfrom, const vec3& lookat, const vec3& vup, real vfov, real aperture, real focus_dist, std::string& error)
+{
+    const vec3 view   = lookfrom - lookat;
+    const auto usable = [](real length2) { return length2 > 0 && std::isfinite(length2); };
+    if (!valid_vfov(vfov))
+    {
+        error = "vfov must be between 0 and 180 degrees";
+    }
+    else if (!valid_aperture(aperture))
+    {
+        error = "aperture must not be negative";
+    }
+    else if (!valid_focus_dist(focus_dist))
+    {
+        error = "focus distance must be greater than 0";
+    }
+    else if (!usable(view.length_squared()))
+    {
+        error = "lookfrom and lookat must differ";
+    }
+    else if (!usable(cross(vup, view).length_squared()))
+    {
+        error = "view direction must not be parallel to vup";
+    }
+    else
+    {
+        return true;
+    }
+    return false;
+}
 
 class camera
 {
 public:
     camera(vec3 lookfrom, vec3 lookat, vec3 vup,
-        double vfov, // top to bottom, in degrees
-        double aspect, double aperture, double focus_dist, double t0 = 0, double t1 = 0)
+        real vfov, // top to bottom, in degrees
+        real aspect, real aperture, real focus_dist, real t0 = 0, real t1 = 0)
     {
         origin           = lookfrom;
         lens_radius      = aperture / 2;
@@ -27,11 +83,71 @@ public:
         vertical   = 2 * half_height * focus_dist * v;
     }
 
-    ray get_ray(double s, double t)
+    ray get_ray(real s, real t) const
+    {
+        // 一次取出镜头采样和快门时间需要的3个随机数
+        double xi[3];
+        thread_rng().fill(xi);
+
+        vec3 rd     = lens_radius * random_in_unit_disk(xi[0], xi[1]);
+        vec3 offset = u * rd.x() + v * rd.y();
+        return ray(origin + offset, lower_left_corner + s * horizontal + t * vertical - origin - offset, time0 + (time1 - time0) * xi[2]);
+    }
+
+    /// @brief 镜头上的位置和快门时间分别取自采样器的sample_dimension::lens和sample_dimension::time维，
+    /// 采样器是independent时与get_ray(s, t)相同
+    ray get_ray(real s, real t, sampler& samples) const
     {
-        vec3 rd     = lens_radius * random_in_unit_disk();
+        double lens[2];
+        samples.get(sample_dimension::lens, lens);
+        const double time = samples.get_1d(sample_dimension::time);
+
+        vec3 rd     = lens_radius * random_in_unit_disk(lens[0], lens[1]);
         vec3 offset = u * rd.x() + v * rd.y();
-        return ray(origin + offset, lower_left_corner + s * horizontal + t * vertical - origin - offset, random_double(time0, time1));
+        return ray(origin + offset, lower_left_corner + s * horizontal + t * vertical - origin - offset, time0 + (time1 - time0) * time);
+    }
+
+    /// @brief 一次生成一块像素的主光线，每个像素一条，按结构数组写入block
+    /// 像素内的位置按样本序号分层抖动（见stratified_jitter），整块需要的随机数一次从generator中取出，
+    /// 与逐条调用get_ray的期望相同
+    /// @param i0 块左下角像素的列（从左往右）
+    /// @param j0 块左下角像素的行（从下往上）
+    /// @param columns 块的列数，不超过ray_block::width，rows同理
+    /// @param sample 这一块光线的样本序号
+    /// @param samples_per_pixel 每个像素的样本数
+    void get_ray_block(int i0, int j0, int columns, int rows, int image_width, int image_height, int sample, int samples_per_pixel, rng& generator,
+                       ray_block& block) const
+    {
+        // 每条光线5个随机数：像素内的位置、镜头采样和快门时间
+        double xi[ray_block::size][5];
+        generator.fill(std::span<double>(&xi[0][0], static_cast<size_t>(columns) * rows * 5));
+
+        block.active = 0;
+        int n         = 0;
+        for (int r = 0; r < rows; ++r)
+        {
+            for (int c = 0; c < columns; ++c, ++n)
+            {
+                const int k = r * ray_block::width + c;
+
+                double jitter[2];
+                stratified_jitter(sample, samples_per_pixel, xi[n], jitter);
+                const real s = (i0 + c + jitter[0]) / image_width;
+                const real t = (j0 + r + jitter[1]) / image_height;
+
+                const vec3 rd     = lens_radius * random_in_unit_disk(xi[n][2], xi[n][3]);
+                const vec3 offset = u * rd.x() + v * rd.y();
+                const vec3 o      = origin + offset;
+                const vec3 d      = lower_left_corner + s * horizontal + t * vertical - o;
+                for (int a = 0; a < 3; ++a)
+                {
+                    block.origin[a][k]    = o[a];
+                    block.direction[a][k] = d[a];
+                }
+                block.time[k] = time0 + (time1 - time0) * xi[n][4];
+                block.active |= uint64_t(1) << k;
+            }
+        }
     }
 
 public:
@@ -40,6 +156,6 @@ public:
     vec3 horizontal;
     vec3 vertical;
     vec3 u, v, w;
-    double lens_radius;
-    double time0, time1; // shutter open/close times
+    real lens_radius;
+    real time0, time1; // shutter open/close times
 };
\ No newline at end of file
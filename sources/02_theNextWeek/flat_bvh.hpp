@@ -0,0 +1,597 @@
+#pragma once
+
+#include "bvh_builder.hpp"
+#include "hittable_list.hpp"
+#include "simd.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <type_traits>
+#include <vector>
+
+/// @brief 光线与节点包围盒求交，相交时t_entry为进入包围盒的参数
+inline bool intersect_node(const flat_bvh_node& node, const ray_traversal_data& rd, double tmin, double tmax, double& t_entry) noexcept
+{
+    stats::count_box_test();
+
+    // bounds_max之后紧跟着offset，可以按4个float读取
+    return intersect_box(node.bounds_min, node.bounds_max, rd, tmin, tmax, t_entry);
+}
+
+/// @brief 光线与运动模糊BVH节点在快门时间u处的包围盒求交
+/// 节点的float包围盒已经向外取整，double插值的舍入误差远小于取整的余量
+inline bool intersect_node(const motion_bvh_node& node, const ray_traversal_data& rd, double u, double tmin, double tmax, double& t_entry) noexcept
+{
+    stats::count_box_test();
+
+    // 每个包围盒数组之后都紧跟着其他成员，可以按4个float读取
+    return intersect_motion_box(node.bounds0_min, node.bounds0_max, node.bounds1_min, node.bounds1_max, u, rd, tmin, tmax, t_entry);
+}
+
+/// @brief 用显式栈遍历线性存储的BVH，节点可以是flat_bvh_node或motion_bvh_node
+/// 先访问离光线起点近的孩子，找到更近的交点后跳过更远的孩子
+/// @param u 光线时刻在快门时间内的位置（0到1），只用于motion_bvh_node
+/// @param leaf 与叶子中的图元求交，签名为bool(const Node& leaf, real& closest)，
+///             找到比closest更近的交点时更新closest并返回true
+/// @return 是否找到交点
+template <typename Node, typename LeafIntersector>
+bool traverse_bvh_nodes(std::span<const Node> nodes, const ray& r, real t_min, real t_max, double u, LeafIntersector&& leaf)
+{
+    const auto intersect = [&](const Node& node, double tmin, double tmax, double& t_entry, const ray_traversal_data& rd) {
+        if constexpr (std::is_same_v<Node, motion_bvh_node>)
+        {
+            return intersect_node(node, rd, u, tmin, tmax, t_entry);
+        }
+        else
+        {
+            return intersect_node(node, rd, tmin, tmax, t_entry);
+        }
+    };
+
+    if (nodes.empty())
+    {
+        return false;
+    }
+
+    struct stack_entry
+    {
+        uint32_t node;
+        double t_entry;
+    };
+
+    std::array<stack_entry, bvh_max_depth> stack;
+    size_t stack_size = 0;
+
+    const ray_traversal_data rd(r);
+    real closest      = t_max;
+    bool hit_anything = false;
+
+    double t_root = 0;
+    if (!intersect(nodes[0], t_min, closest, t_root, rd))
+    {
+        return false;
+    }
+
+    uint32_t current = 0;
+    while (true)
+    {
+        const auto& node = nodes[current];
+        stats::count_node_visit();
+
+        if (node.is_leaf())
+        {
+            hit_anything |= leaf(node, closest);
+        }
+        else
+        {
+            // 根据光线方向在划分轴上的符号决定远近
+            uint32_t near_child = current + 1;
+            uint32_t far_child  = node.offset;
+            if (rd.dir_is_neg[node.axis])
+            {
+                std::swap(near_child, far_child);
+            }
+
+            double t_near = 0, t_far = 0;
+            bool hit_near = intersect(nodes[near_child], t_min, closest, t_near, rd);
+            bool hit_far  = intersect(nodes[far_child], t_min, closest, t_far, rd);
+
+            if (hit_near && hit_far)
+            {
+                if (t_far < t_near)
+                {
+                    std::swap(near_child, far_child);
+                    std::swap(t_near, t_far);
+                }
+                stack[stack_size++] = { far_child, t_far };
+                current             = near_child;
+                continue;
+            }
+            if (hit_near || hit_far)
+            {
+                current = hit_near ? near_child : far_child;
+                continue;
+            }
+        }
+
+        // 出栈，已经找到更近交点的节点直接跳过
+        bool found = false;
+        while (stack_size > 0)
+        {
+            const auto entry = stack[--stack_size];
+            if (entry.t_entry <= closest)
+            {
+                current = entry.node;
+                found   = true;
+                break;
+            }
+        }
+        if (!found)
+        {
+            break;
+        }
+    }
+
+    return hit_anything;
+}
+
+/// @brief 遍历静态的BVH，见traverse_bvh_nodes
+template <typename LeafIntersector>
+bool traverse_bvh(std::span<const flat_bvh_node> nodes, const ray& r, real t_min, real t_max, LeafIntersector&& leaf)
+{
+    return traverse_bvh_nodes(nodes, r, t_min, t_max, 0.0, leaf);
+}
+
+/// @brief 遍历运动模糊BVH，节点的包围盒按u插值，见traverse_bvh_nodes
+template <typename LeafIntersector>
+bool traverse_bvh(std::span<const motion_bvh_node> nodes, const ray& r, real t_min, real t_max, double u, LeafIntersector&& leaf)
+{
+    return traverse_bvh_nodes(nodes, r, t_min, t_max, u, leaf);
+}
+
+/// @brief 任意交点遍历：找到第一个交点就返回，不区分孩子的远近，用于阴影光线
+/// @param leaf 测试叶子中的图元，签名为bool(const Node& leaf)，(t_min, t_max)内有交点时返回true
+/// @return (t_min, t_max)内是否有交点
+template <typename Node, typename LeafTest>
+bool traverse_bvh_any_nodes(std::span<const Node> nodes, const ray& r, real t_min, real t_max, double u, LeafTest&& leaf)
+{
+    if (nodes.empty())
+    {
+        return false;
+    }
+
+    const ray_traversal_data rd(r);
+    const auto intersect = [&](const Node& node) {
+        double t_entry = 0;
+        if constexpr (std::is_same_v<Node, motion_bvh_node>)
+        {
+            return intersect_node(node, rd, u, t_min, t_max, t_entry);
+        }
+        else
+        {
+            return intersect_node(node, rd, t_min, t_max, t_entry);
+        }
+    };
+
+    if (!intersect(nodes[0]))
+    {
+        return false;
+    }
+
+    std::array<uint32_t, bvh_max_depth> stack;
+    size_t stack_size = 0;
+    uint32_t current  = 0;
+    while (true)
+    {
+        const auto& node = nodes[current];
+        stats::count_node_visit();
+
+        if (node.is_leaf())
+        {
+            if (leaf(node))
+            {
+                return true;
+            }
+        }
+        else
+        {
+            const uint32_t left  = current + 1;
+            const uint32_t right = node.offset;
+            const bool hit_left  = intersect(nodes[left]);
+            const bool hit_right = intersect(nodes[right]);
+            if (hit_left && hit_right)
+            {
+                stack[stack_size++] = right;
+                current             = left;
+                continue;
+            }
+            if (hit_left || hit_right)
+            {
+                current = hit_left ? left : right;
+                continue;
+            }
+        }
+
+        if (stack_size == 0)
+        {
+            return false;
+        }
+        current = stack[--stack_size];
+    }
+}
+
+/// @brief 静态BVH的任意交点遍历，见traverse_bvh_any_nodes
+template <typename LeafTest>
+bool traverse_bvh_any(std::span<const flat_bvh_node> nodes, const ray& r, real t_min, real t_max, LeafTest&& leaf)
+{
+    return traverse_bvh_any_nodes(nodes, r, t_min, t_max, 0.0, leaf);
+}
+
+/// @brief 运动模糊BVH的任意交点遍历，见traverse_bvh_any_nodes
+template <typename LeafTest>
+bool traverse_bvh_any(std::span<const motion_bvh_node> nodes, const ray& r, real t_min, real t_max, double u, LeafTest&& leaf)
+{
+    return traverse_bvh_any_nodes(nodes, r, t_min, t_max, u, leaf);
+}
+
+/// @brief 光线包遍历时预先计算好的数据：按simd_width条一组的ray_packet（用于intersect_ray_packet），
+/// 每条光线的ray_traversal_data（用于运动模糊BVH），以及整个包的起点、方向倒数和时刻的区间
+struct ray_block_traversal
+{
+    static constexpr int group_count = ray_block::size / simd_width;
+
+    std::array<ray_packet, group_count> groups; // 第k条光线是groups[k / simd_width]的第k % simd_width个通道
+    std::array<ray_traversal_data, ray_block::size> rays;
+    double u[ray_block::size]; // 光线时刻在快门时间内的位置，只用于motion_bvh_node
+    double origin_min[3], origin_max[3];
+    double inv_min[3], inv_max[3];
+    bool coherent[3];  // 这个轴上所有光线方向的符号相同，区间测试只使用这样的轴
+    int dir_is_neg[3]; // 第一条光线方向的符号，决定孩子的访问顺序
+    double u_min, u_max;
+
+    /// @param time0 快门打开时间
+    /// @param inv_shutter 1 / 快门时长，为0时所有光线的u都是0
+    ray_block_traversal(const ray_block& block, real t_min, real t_max, double time0 = 0.0, double inv_shutter = 0.0) noexcept
+    {
+        for (int a = 0; a < 3; ++a)
+        {
+            origin_min[a] = inv_min[a] = infinity;
+            origin_max[a] = inv_max[a] = -infinity;
+        }
+        u_min = 1.0;
+        u_max = 0.0;
+
+        for (auto& group : groups)
+        {
+            // 不活动的通道tmin > tmax，永远不会相交
+            std::fill(std::begin(group.tmin), std::end(group.tmin), 1.0f);
+            std::fill(std::begin(group.tmax), std::end(group.tmax), 0.0f);
+        }
+
+        for (uint64_t mask = block.active; mask != 0; mask &= mask - 1)
+        {
+            const int k = std::countr_zero(mask);
+            rays[k]     = ray_traversal_data(block.get(k));
+            u[k]        = std::clamp((block.time[k] - time0) * inv_shutter, 0.0, 1.0);
+            u_min       = std::min(u_min, u[k]);
+            u_max       = std::max(u_max, u[k]);
+            for (int a = 0; a < 3; ++a)
+            {
+                origin_min[a] = std::min(origin_min[a], rays[k].origin[a]);
+                origin_max[a] = std::max(origin_max[a], rays[k].origin[a]);
+                inv_min[a]    = std::min(inv_min[a], rays[k].inv_dir[a]);
+                inv_max[a]    = std::max(inv_max[a], rays[k].inv_dir[a]);
+                groups[k / simd_width].origin[a][k % simd_width]  = rays[k].origin_f[a];
+                groups[k / simd_width].inv_dir[a][k % simd_width] = rays[k].inv_dir_f[a];
+            }
+            groups[k / simd_width].tmin[k % simd_width] = static_cast<float>(t_min);
+            set_tmax(k, t_max);
+        }
+
+        // 空的块不会被遍历，访问顺序取任意值，不读取未初始化的光线
+        const int first = std::countr_zero(block.active);
+        for (int a = 0; a < 3; ++a)
+        {
+            coherent[a]   = std::isfinite(inv_min[a]) && std::isfinite(inv_max[a]) && (inv_min[a] > 0 || inv_max[a] < 0);
+            dir_is_neg[a] = block.active != 0 ? rays[first].dir_is_neg[a] : 0;
+        }
+    }
+
+    /// @brief 第k条光线找到更近的交点后更新float的tmax，向上取整，不会剔除closest处的包围盒
+    void set_tmax(int k, real closest) noexcept
+    {
+        float t = static_cast<float>(closest);
+        if (t < closest)
+        {
+            t = std::nextafter(t, std::numeric_limits<float>::infinity());
+        }
+        groups[k / simd_width].tmax[k % simd_width] = t;
+    }
+
+    /// @brief 区间测试：把包中所有光线的起点和方向倒数看作区间，用区间算术求出进入和离开包围盒的参数的界，
+    /// 返回false时包中没有光线与包围盒相交，相当于用光线包的视锥剔除；方向符号不一致的轴不参与测试，结果仍然是保守的
+    bool may_intersect(const double lo[3], const double hi[3], double tmin, double tmax) const noexcept
+    {
+        stats::count_box_test();
+
+        for (int a = 0; a < 3; ++a)
+        {
+            if (!coherent[a])
+            {
+                continue;
+            }
+
+            // 正方向先穿过lo，负方向先穿过hi
+            const double near_plane = inv_min[a] > 0 ? lo[a] : hi[a];
+            const double far_plane  = inv_min[a] > 0 ? hi[a] : lo[a];
+            const double n0 = (near_plane - origin_max[a]) * inv_min[a], n1 = (near_plane - origin_max[a]) * inv_max[a];
+            const double n2 = (near_plane - origin_min[a]) * inv_min[a], n3 = (near_plane - origin_min[a]) * inv_max[a];
+            const double f0 = (far_plane - origin_max[a]) * inv_min[a], f1 = (far_plane - origin_max[a]) * inv_max[a];
+            const double f2 = (far_plane - origin_min[a]) * inv_min[a], f3 = (far_plane - origin_min[a]) * inv_max[a];
+            tmin = std::max(tmin, std::min({ n0, n1, n2, n3 }));
+            tmax = std::min(tmax, std::max({ f0, f1, f2, f3 }));
+        }
+        return tmin <= tmax;
+    }
+};
+
+/// @brief 节点在包中所有光线的时刻内的包围盒，用于区间测试
+inline void block_node_bounds(const flat_bvh_node& node, const ray_block_traversal&, double lo[3], double hi[3]) noexcept
+{
+    for (int a = 0; a < 3; ++a)
+    {
+        lo[a] = node.bounds_min[a];
+        hi[a] = node.bounds_max[a];
+    }
+}
+
+/// @brief 包围盒随时间线性变化，u_min和u_max处两个包围盒的并集包含了中间所有时刻的包围盒
+inline void block_node_bounds(const motion_bvh_node& node, const ray_block_traversal& block, double lo[3], double hi[3]) noexcept
+{
+    for (int a = 0; a < 3; ++a)
+    {
+        const double dmin = double(node.bounds1_min[a]) - node.bounds0_min[a];
+        const double dmax = double(node.bounds1_max[a]) - node.bounds0_max[a];
+        lo[a]             = std::min(node.bounds0_min[a] + block.u_min * dmin, node.bounds0_min[a] + block.u_max * dmin);
+        hi[a]             = std::max(node.bounds0_max[a] + block.u_min * dmax, node.bounds0_max[a] + block.u_max * dmax);
+    }
+}
+
+/// @brief 光线包遍历BVH，包中的所有光线共享节点的读取和遍历栈
+/// 每个节点先用区间测试剔除整个包都不会相交的节点，再测试仍然活动的光线（静态节点每simd_width条一组用intersect_ray_packet），
+/// 只有相交的光线继续访问子树；孩子按第一条光线的方向排序，每条光线找到的最近交点与traverse_bvh相同
+/// @param closest 每条光线当前最近的交点，初始化为t_max
+/// @param leaf 与叶子中的图元求交，签名为uint64_t(const Node& leaf, uint64_t mask)，
+///             mask是与叶子包围盒相交的光线，返回找到更近交点的光线，这些光线的closest已经更新
+/// @return 找到交点的光线
+template <typename Node, typename LeafIntersector>
+uint64_t traverse_bvh_block(std::span<const Node> nodes, ray_block_traversal& block, uint64_t active, real t_min, real* closest, LeafIntersector&& leaf)
+{
+    if (nodes.empty() || active == 0)
+    {
+        return 0;
+    }
+
+    // 区间测试的上界：所有光线中最远的closest，只在有光线找到更近的交点后重新计算
+    double t_far = -infinity;
+    const auto update_t_far = [&] {
+        t_far = -infinity;
+        for (uint64_t m = active; m != 0; m &= m - 1)
+        {
+            t_far = std::max<double>(t_far, closest[std::countr_zero(m)]);
+        }
+    };
+    update_t_far();
+
+    // 与node相交的光线
+    const auto intersect = [&](const Node& node, uint64_t mask) {
+        double lo[3], hi[3];
+        block_node_bounds(node, block, lo, hi);
+        if (!block.may_intersect(lo, hi, t_min, t_far))
+        {
+            return uint64_t(0);
+        }
+
+        uint64_t hit = 0;
+        if constexpr (std::is_same_v<Node, motion_bvh_node>)
+        {
+            // 每条光线的时刻不同，包围盒也不同
+            for (uint64_t m = mask; m != 0; m &= m - 1)
+            {
+                const int k    = std::countr_zero(m);
+                double t_entry = 0;
+                hit |= uint64_t(intersect_node(node, block.rays[k], block.u[k], t_min, closest[k], t_entry)) << k;
+            }
+        }
+        else
+        {
+            constexpr uint64_t group_mask = (uint64_t(1) << (simd_width - 1) << 1) - 1;
+            for (int g = 0; g < ray_block_traversal::group_count; ++g)
+            {
+                const uint64_t lanes = (mask >> (g * simd_width)) & group_mask;
+                if (lanes != 0)
+                {
+                    stats::count_box_test();
+                    hit |= (uint64_t(intersect_ray_packet(block.groups[g], node.bounds_min, node.bounds_max)) & lanes) << (g * simd_width);
+                }
+            }
+        }
+        return hit;
+    };
+
+    struct stack_entry
+    {
+        uint32_t node;
+        uint64_t mask;
+        bool hit_closer; // 入栈之后是否有光线找到了更近的交点
+    };
+
+    std::array<stack_entry, bvh_max_depth> stack;
+    size_t stack_size = 0;
+
+    uint64_t hit_rays = 0;
+    uint64_t mask     = intersect(nodes[0], active);
+    uint32_t current  = 0;
+    while (mask != 0 || stack_size > 0)
+    {
+        if (mask == 0)
+        {
+            // 入栈之后其他光线可能已经找到了更近的交点，重新测试
+            const auto entry = stack[--stack_size];
+            current          = entry.node;
+            mask             = entry.hit_closer ? intersect(nodes[current], entry.mask) : entry.mask;
+            continue;
+        }
+
+        const auto& node = nodes[current];
+        stats::count_node_visit();
+
+        if (node.is_leaf())
+        {
+            const uint64_t found = leaf(node, mask);
+            for (uint64_t m = found; m != 0; m &= m - 1)
+            {
+                const int k = std::countr_zero(m);
+                block.set_tmax(k, closest[k]);
+            }
+            if (found != 0)
+            {
+                update_t_far();
+                for (size_t e = 0; e < stack_size; ++e)
+                {
+                    stack[e].hit_closer |= (stack[e].mask & found) != 0;
+                }
+            }
+            hit_rays |= found;
+            mask = 0;
+            continue;
+        }
+
+        uint32_t near_child = current + 1;
+        uint32_t far_child  = node.offset;
+        if (block.dir_is_neg[node.axis])
+        {
+            std::swap(near_child, far_child);
+        }
+
+        const uint64_t near_mask = intersect(nodes[near_child], mask);
+        const uint64_t far_mask  = intersect(nodes[far_child], mask);
+        if (far_mask != 0)
+        {
+            stack[stack_size++] = { far_child, far_mask, false };
+        }
+        current = near_child;
+        mask    = near_mask;
+    }
+
+    return hit_rays;
+}
+
+/// @brief 编译好的BVH，所有节点存储在一块连续内存中，用traverse_bvh遍历
+class flat_bvh : public hittable
+{
+public:
+    flat_bvh(const hittable_list& list, real time0, real time1, const bvh_build_options& options = {})
+        : flat_bvh(list.objects(), time0, time1, options)
+    {
+    }
+
+    /// @brief objects中的物体不归flat_bvh所有，生命周期必须长于flat_bvh
+    flat_bvh(const std::vector<const hittable*>& objects, real time0, real time1, const bvh_build_options& options = {})
+        : _options(options)
+    {
+        std::vector<aabb> boxes;
+        std::vector<uint32_t> source; // boxes[i]对应的图元是objects[source[i]]
+        boxes.reserve(objects.size());
+        source.reserve(objects.size());
+
+        for (size_t i = 0; i < objects.size(); ++i)
+        {
+            aabb box {};
+            if (!objects[i]->bounding_box(time0, time1, box))
+            {
+                std::cerr << "No bounding box in flat_bvh constructor.\n";
+                continue;
+            }
+            boxes.push_back(box);
+            source.push_back(static_cast<uint32_t>(i));
+        }
+
+        auto result = bvh_builder(options).build(boxes);
+        _nodes      = std::move(result.nodes);
+
+        // 叶子引用的图元按遍历顺序连续存放
+        _primitives.reserve(result.primitive_indices.size());
+        for (auto index : result.primitive_indices)
+        {
+            _primitives.push_back(objects[source[index]]);
+        }
+    }
+
+    virtual bool hit(const ray& r, real t_min, real t_max, hit_record& rec) const override
+    {
+        return traverse_bvh(_nodes, r, t_min, t_max, [&](const flat_bvh_node& leaf, real& closest) {
+            bool hit_anything = false;
+            for (uint32_t i = leaf.offset; i < leaf.offset + leaf.count; ++i)
+            {
+                if (_primitives[i]->hit(r, t_min, closest, rec))
+                {
+                    hit_anything = true;
+                    closest      = rec.t;
+                }
+            }
+            return hit_anything;
+        });
+    }
+
+    virtual bool occluded(const ray& r, real t_min, real t_max) const override
+    {
+        return traverse_bvh_any(std::span<const flat_bvh_node>(_nodes), r, t_min, t_max, [&](const flat_bvh_node& leaf) {
+            for (uint32_t i = leaf.offset; i < leaf.offset + leaf.count; ++i)
+            {
+                if (_primitives[i]->occluded(r, t_min, t_max))
+                {
+                    return true;
+                }
+            }
+            return false;
+        });
+    }
+
+    virtual bool bounding_box(real t0, real t1, aabb& output_box) const override
+    {
+        if (_nodes.empty())
+        {
+            return false;
+        }
+
+        output_box = node_box(_nodes[0]);
+        return true;
+    }
+
+    const std::vector<flat_bvh_node>& nodes() const noexcept
+    {
+        return _nodes;
+    }
+
+    /// @brief 整棵树的SAH代价，见bvh_sah_cost
+    double sah_cost() const noexcept
+    {
+        return bvh_sah_cost(_nodes, _options);
+    }
+
+    const bvh_build_options& options() const noexcept
+    {
+        return _options;
+    }
+
+private:
+    bvh_build_options _options;
+    std::vector<flat_bvh_node> _nodes;
+    std::vector<const hittable*> _primitives; // 按叶子顺序排列的图元
+};
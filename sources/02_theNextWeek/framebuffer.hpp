@@ -0,0 +1,452 @@
+#pragma once
+
+#include "rtweekend.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/// @brief 输出图像的格式
+enum class image_format
+{
+    ppm, // 二进制P6，8位，gamma 2
+    pfm, // 32位浮点HDR，线性颜色
+    png, // 8位RGB，gamma 2
+};
+
+/// @brief 根据文件扩展名选择图像格式，无法识别时使用ppm
+inline image_format image_format_from_path(std::string_view path) noexcept
+{
+    auto ends_with = [&](std::string_view ext) {
+        return path.size() >= ext.size() && path.substr(path.size() - ext.size()) == ext;
+    };
+
+    if (ends_with(".pfm"))
+    {
+        return image_format::pfm;
+    }
+    if (ends_with(".png"))
+    {
+        return image_format::png;
+    }
+    return image_format::ppm;
+}
+
+/// @brief 颜色的亮度（Rec. 709）
+inline double luminance(const vec3& c) noexcept
+{
+    return 0.2126 * c.x() + 0.7152 * c.y() + 0.0722 * c.z();
+}
+
+/// @brief 帧缓冲，保存每个像素的样本颜色之和、亮度平方和与样本数，第0行是图像的最上面一行
+/// 渲染线程只向自己负责的像素累加，图像在渲染结束后一次性编码、一次写出
+class framebuffer
+{
+public:
+    framebuffer() noexcept = default;
+
+    framebuffer(int width, int height)
+        : _width(width)
+        , _height(height)
+        , _sum(static_cast<size_t>(width) * height, vec3(0, 0, 0))
+        , _luminance_sq(static_cast<size_t>(width) * height, 0.0)
+        , _samples(static_cast<size_t>(width) * height, 0)
+    {
+    }
+
+    int width() const noexcept
+    {
+        return _width;
+    }
+
+    int height() const noexcept
+    {
+        return _height;
+    }
+
+    /// @brief 向像素(x, y)累加samples个样本的颜色之和
+    void add(int x, int y, const vec3& color_sum, uint32_t samples) noexcept
+    {
+        const auto index = pixel_index(x, y);
+        _sum[index] += color_sum;
+        _samples[index] += samples;
+    }
+
+    /// @brief 向像素(x, y)累加一个样本，同时记录亮度的平方用于估计方差
+    void add_sample(int x, int y, const vec3& color) noexcept
+    {
+        const auto index = pixel_index(x, y);
+        const double l   = luminance(color);
+        _sum[index] += color;
+        _luminance_sq[index] += l * l;
+        _samples[index] += 1;
+    }
+
+    const vec3& sum(int x, int y) const noexcept
+    {
+        return _sum[pixel_index(x, y)];
+    }
+
+    uint32_t samples(int x, int y) const noexcept
+    {
+        return _samples[pixel_index(x, y)];
+    }
+
+    /// @brief 像素的平均颜色（线性），没有样本时为黑色
+    vec3 color(int x, int y) const noexcept
+    {
+        const auto index = pixel_index(x, y);
+        if (_samples[index] == 0)
+        {
+            return vec3(0, 0, 0);
+        }
+        return _sum[index] / _samples[index];
+    }
+
+    /// @brief 像素样本亮度的无偏样本方差，只统计通过add_sample添加的样本，少于2个样本时为0
+    double variance(int x, int y) const noexcept
+    {
+        const auto index = pixel_index(x, y);
+        const auto n     = _samples[index];
+        if (n < 2)
+        {
+            return 0.0;
+        }
+        const double mean = luminance(_sum[index]) / n;
+        return std::max(0.0, (_luminance_sq[index] - n * mean * mean) / (n - 1));
+    }
+
+    /// @brief 像素均值在输出（gamma 2）空间中的标准误差，用于判断像素是否收敛
+    /// 线性空间的标准误差sqrt(variance / n)经过sqrt映射后约为sqrt(variance / n) / (2 sqrt(mean))，
+    /// 与显示出的噪声成正比，暗像素不会因为相对误差大而一直采样
+    double display_error(int x, int y) const noexcept
+    {
+        const auto n = samples(x, y);
+        if (n == 0)
+        {
+            return infinity;
+        }
+        const double mean = luminance(sum(x, y)) / n;
+        return std::sqrt(variance(x, y) / n) / (2 * std::sqrt(std::max(mean, 1e-4)));
+    }
+
+    /// @brief 转换为按行存储的8位RGB，gamma 2，与vec3::write_color的结果相同
+    std::vector<uint8_t> to_rgb8() const
+    {
+        std::vector<uint8_t> pixels(_sum.size() * 3);
+        for (size_t i = 0; i < _sum.size(); ++i)
+        {
+            const auto scale = _samples[i] == 0 ? 0.0 : 1.0 / _samples[i];
+            for (size_t c = 0; c < 3; ++c)
+            {
+                pixels[i * 3 + c] = static_cast<uint8_t>(256 * clamp(sqrt(scale * _sum[i][c]), 0.0, 0.999));
+            }
+        }
+        return pixels;
+    }
+
+    void write_ppm(std::ostream& out) const
+    {
+        const std::string header = "P6\n" + std::to_string(_width) + " " + std::to_string(_height) + "\n255\n";
+        const auto pixels        = to_rgb8();
+
+        out.write(header.data(), static_cast<std::streamsize>(header.size()));
+        out.write(reinterpret_cast<const char*>(pixels.data()), static_cast<std::streamsize>(pixels.size()));
+    }
+
+    /// @brief PFM按从下到上的顺序存储，比例因子为负数表示小端
+    void write_pfm(std::ostream& out) const
+    {
+        const std::string header = "PF\n" + std::to_string(_width) + " " + std::to_string(_height) + "\n-1.0\n";
+
+        std::vector<float> pixels(_sum.size() * 3);
+        size_t k = 0;
+        for (int y = _height - 1; y >= 0; --y)
+        {
+            for (int x = 0; x < _width; ++x)
+            {
+                const vec3 c = color(x, y);
+                for (size_t a = 0; a < 3; ++a)
+                {
+                    pixels[k++] = static_cast<float>(c[a]);
+                }
+            }
+        }
+
+        if constexpr (std::endian::native == std::endian::big)
+        {
+            for (auto& p : pixels)
+            {
+                uint32_t bits;
+                std::memcpy(&bits, &p, sizeof(bits));
+                bits = byteswap32(bits);
+                std::memcpy(&p, &bits, sizeof(bits));
+            }
+        }
+
+        out.write(header.data(), static_cast<std::streamsize>(header.size()));
+        out.write(reinterpret_cast<const char*>(pixels.data()), static_cast<std::streamsize>(pixels.size() * sizeof(float)));
+    }
+
+    /// @brief 不依赖zlib的PNG编码，图像数据使用不压缩的deflate块存储
+    void write_png(std::ostream& out) const
+    {
+        const auto pixels      = to_rgb8();
+        const size_t row_bytes = static_cast<size_t>(_width) * 3;
+
+        // 每行前加一个过滤类型字节（0，不过滤）
+        std::vector<uint8_t> raw;
+        raw.reserve((row_bytes + 1) * _height);
+        for (int y = 0; y < _height; ++y)
+        {
+            raw.push_back(0);
+            raw.insert(raw.end(), pixels.begin() + y * row_bytes, pixels.begin() + (y + 1) * row_bytes);
+        }
+
+        // zlib格式：2字节头，若干个最长65535字节的不压缩块，4字节adler32
+        std::vector<uint8_t> zlib { 0x78, 0x01 };
+        zlib.reserve(raw.size() + raw.size() / 65535 * 5 + 16);
+        size_t pos = 0;
+        do
+        {
+            const auto length = static_cast<uint16_t>(std::min<size_t>(raw.size() - pos, 65535));
+            const bool last   = pos + length == raw.size();
+            zlib.push_back(last ? 1 : 0);
+            zlib.push_back(static_cast<uint8_t>(length));
+            zlib.push_back(static_cast<uint8_t>(length >> 8));
+            zlib.push_back(static_cast<uint8_t>(~length));
+            zlib.push_back(static_cast<uint8_t>(~length >> 8));
+            zlib.insert(zlib.end(), raw.begin() + pos, raw.begin() + pos + length);
+            pos += length;
+        } while (pos < raw.size());
+        put_u32(zlib, adler32(raw));
+
+        std::vector<uint8_t> png { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+
+        std::vector<uint8_t> ihdr;
+        put_u32(ihdr, static_cast<uint32_t>(_width));
+        put_u32(ihdr, static_cast<uint32_t>(_height));
+        ihdr.insert(ihdr.end(), { 8, 2, 0, 0, 0 }); // 8位，RGB，deflate，标准过滤，不隔行
+
+        put_chunk(png, "IHDR", ihdr);
+        put_chunk(png, "IDAT", zlib);
+        put_chunk(png, "IEND", {});
+
+        out.write(reinterpret_cast<const char*>(png.data()), static_cast<std::streamsize>(png.size()));
+    }
+
+    void write(std::ostream& out, image_format format) const
+    {
+        switch (format)
+        {
+        case image_format::pfm:
+            write_pfm(out);
+            break;
+        case image_format::png:
+            write_png(out);
+            break;
+        default:
+            write_ppm(out);
+            break;
+        }
+    }
+
+    /// @brief 保存到文件，格式由扩展名决定
+    /// @return 是否写入成功
+    bool save(const std::string& path) const
+    {
+        return save(path, image_format_from_path(path));
+    }
+
+    /// @brief 按指定的格式保存到文件
+    /// @return 是否写入成功
+    bool save(const std::string& path, image_format format) const
+    {
+        std::ofstream file(path, std::ios::binary);
+        if (!file)
+        {
+            return false;
+        }
+        write(file, format);
+        return static_cast<bool>(file);
+    }
+
+    /// @brief 读取save写出的P6或PFM图像（不支持PNG），每个像素记为1个样本
+    /// P6的8位值按gamma 2转换回线性颜色，再次写出时得到相同的8位值
+    /// @return 是否读取成功
+    bool load(const std::string& path)
+    {
+        std::ifstream file(path, std::ios::binary);
+        std::string magic;
+        int width = 0, height = 0;
+        double scale = 0;
+        if (!(file >> magic >> width >> height >> scale) || width <= 0 || height <= 0 || (magic != "P6" && magic != "PF"))
+        {
+            return false;
+        }
+        file.get(); // 头部之后的一个空白字符
+
+        *this = framebuffer(width, height);
+        if (magic == "P6")
+        {
+            std::vector<uint8_t> pixels(_sum.size() * 3);
+            file.read(reinterpret_cast<char*>(pixels.data()), static_cast<std::streamsize>(pixels.size()));
+            for (size_t i = 0; i < _sum.size(); ++i)
+            {
+                for (size_t c = 0; c < 3; ++c)
+                {
+                    const double v = (pixels[i * 3 + c] + 0.5) / 256;
+                    _sum[i][c]     = static_cast<real>(v * v);
+                }
+            }
+        }
+        else
+        {
+            std::vector<float> pixels(_sum.size() * 3);
+            file.read(reinterpret_cast<char*>(pixels.data()), static_cast<std::streamsize>(pixels.size() * sizeof(float)));
+            const bool swap = (scale < 0) != (std::endian::native == std::endian::little);
+            size_t k        = 0;
+            for (int y = _height - 1; y >= 0; --y)
+            {
+                for (int x = 0; x < _width; ++x)
+                {
+                    for (size_t c = 0; c < 3; ++c)
+                    {
+                        float p = pixels[k++];
+                        if (swap)
+                        {
+                            uint32_t bits;
+                            std::memcpy(&bits, &p, sizeof(bits));
+                            bits = byteswap32(bits);
+                            std::memcpy(&p, &bits, sizeof(bits));
+                        }
+                        _sum[pixel_index(x, y)][c] = p;
+                    }
+                }
+            }
+        }
+        std::fill(_samples.begin(), _samples.end(), 1u);
+        return static_cast<bool>(file);
+    }
+
+private:
+    size_t pixel_index(int x, int y) const noexcept
+    {
+        return static_cast<size_t>(y) * _width + x;
+    }
+
+    static uint32_t byteswap32(uint32_t v) noexcept
+    {
+        return (v >> 24) | ((v >> 8) & 0xff00) | ((v << 8) & 0xff0000) | (v << 24);
+    }
+
+    /// @brief 按大端追加一个32位整数
+    static void put_u32(std::vector<uint8_t>& out, uint32_t v)
+    {
+        out.insert(out.end(), { static_cast<uint8_t>(v >> 24), static_cast<uint8_t>(v >> 16), static_cast<uint8_t>(v >> 8), static_cast<uint8_t>(v) });
+    }
+
+    static uint32_t adler32(const std::vector<uint8_t>& data) noexcept
+    {
+        uint32_t a = 1, b = 0;
+        for (auto byte : data)
+        {
+            a = (a + byte) % 65521;
+            b = (b + a) % 65521;
+        }
+        return (b << 16) | a;
+    }
+
+    static uint32_t crc32(const uint8_t* data, size_t size, uint32_t crc = 0) noexcept
+    {
+        static const auto table = [] {
+            std::array<uint32_t, 256> t {};
+            for (uint32_t n = 0; n < 256; ++n)
+            {
+                uint32_t c = n;
+                for (int k = 0; k < 8; ++k)
+                {
+                    c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+                }
+                t[n] = c;
+            }
+            return t;
+        }();
+
+        crc = ~crc;
+        for (size_t i = 0; i < size; ++i)
+        {
+            crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+        }
+        return ~crc;
+    }
+
+    /// @brief 追加一个PNG块：长度、类型、数据、类型和数据的crc32
+    static void put_chunk(std::vector<uint8_t>& out, const char (&type)[5], const std::vector<uint8_t>& data)
+    {
+        put_u32(out, static_cast<uint32_t>(data.size()));
+        const size_t type_pos = out.size();
+        out.insert(out.end(), type, type + 4);
+        out.insert(out.end(), data.begin(), data.end());
+        put_u32(out, crc32(out.data() + type_pos, out.size() - type_pos));
+    }
+
+private:
+    int _width { 0 };
+    int _height { 0 };
+    std::vector<vec3> _sum;            // 每个像素的样本颜色之和
+    std::vector<double> _luminance_sq; // 每个像素样本亮度的平方和
+    std::vector<uint32_t> _samples;    // 每个像素的样本数
+};
+
+/// @brief 两幅图像之间的误差
+struct image_error
+{
+    double rmse_linear { 0 }; // 线性颜色的均方根误差
+    double rmse_8bit { 0 };   // 输出的8位值的均方根误差
+    int max_8bit { 0 };       // 输出的8位值的最大误差
+    double psnr { 0 };        // 8位输出的峰值信噪比（dB），完全相同时为无穷大
+};
+
+/// @brief 逐像素比较两幅大小相同的图像，例如float和double渲染的结果
+inline image_error compare_images(const framebuffer& a, const framebuffer& b)
+{
+    image_error error;
+    if (a.width() != b.width() || a.height() != b.height())
+    {
+        error.rmse_linear = error.rmse_8bit = infinity;
+        error.max_8bit                      = 255;
+        return error;
+    }
+
+    const auto pa = a.to_rgb8();
+    const auto pb = b.to_rgb8();
+
+    double sum_linear = 0, sum_8bit = 0;
+    for (int y = 0; y < a.height(); ++y)
+    {
+        for (int x = 0; x < a.width(); ++x)
+        {
+            const vec3 d = a.color(x, y) - b.color(x, y);
+            sum_linear += d.length_squared();
+        }
+    }
+    for (size_t i = 0; i < pa.size(); ++i)
+    {
+        const int d    = std::abs(int(pa[i]) - int(pb[i]));
+        error.max_8bit = std::max(error.max_8bit, d);
+        sum_8bit += d * d;
+    }
+
+    error.rmse_linear = std::sqrt(sum_linear / pa.size());
+    error.rmse_8bit   = std::sqrt(sum_8bit / pa.size());
+    error.psnr        = error.rmse_8bit > 0 ? 20 * std::log10(255 / error.rmse_8bit) : infinity;
+    return error;
+}
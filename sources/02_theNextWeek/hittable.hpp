@@ -3,14 +3,12 @@
 #include "rtweekend.hpp"
 #include "aabb.hpp"
 
-class material;
-
 struct hit_record
 {
     vec3 p;
     vec3 normal;
-    shared_ptr<material> mat_ptr;
-    double t;
+    real t;
+    uint32_t material_id; // material_table中的下标
     bool front_face;
 
     inline void set_face_normal(const ray& r, const vec3& outward_normal)
@@ -23,6 +21,10 @@ struct hit_record
 class hittable
 {
 public:
-    virtual bool hit(const ray& r, double t_min, double t_max, hit_record& rec) const = 0;
-    virtual bool bounding_box(double t0, double t1, aabb& output_box) const           = 0;
+    virtual bool hit(const ray& r, real t_min, real t_max, hit_record& rec) const = 0;
+
+    /// @brief (t_min, t_max)内是否有任何交点，找到第一个交点就返回，不计算hit_record，用于阴影光线和可见性查询
+    virtual bool occluded(const ray& r, real t_min, real t_max) const = 0;
+
+    virtual bool bounding_box(real t0, real t1, aabb& output_box) const = 0;
 };
\ No newline at end of file
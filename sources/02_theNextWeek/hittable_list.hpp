@@ -2,18 +2,15 @@
 
 #include "hittable.hpp"
 #include "rtweekend.hpp"
-#include <memory>
 #include <vector>
 
-using std::make_shared;
-using std::shared_ptr;
-
+/// @brief 物体列表，只保存指针，不持有物体，物体通常分配在场景的arena中
 class hittable_list : public hittable
 {
 public:
     hittable_list() noexcept = default;
 
-    hittable_list(shared_ptr<hittable> object) noexcept
+    hittable_list(const hittable* object)
     {
         add(object);
     }
@@ -23,18 +20,18 @@ public:
         _objects.clear();
     }
 
-    void add(shared_ptr<hittable> object)
+    void add(const hittable* object)
     {
         _objects.push_back(object);
     }
 
-    virtual bool hit(const ray& r, double t_min, double t_max, hit_record& rec) const override
+    virtual bool hit(const ray& r, real t_min, real t_max, hit_record& rec) const override
     {
         hit_record temp_rec;
         bool hit_anything   = false;
         auto closest_so_far = t_max;
 
-        for (const auto& object : _objects)
+        for (const auto object : _objects)
         {
             if (object->hit(r, t_min, closest_so_far, temp_rec))
             {
@@ -47,7 +44,19 @@ public:
         return hit_anything;
     }
 
-    virtual bool bounding_box(double t0, double t1, aabb& output_box) const override
+    virtual bool occluded(const ray& r, real t_min, real t_max) const override
+    {
+        for (const auto object : _objects)
+        {
+            if (object->occluded(r, t_min, t_max))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    virtual bool bounding_box(real t0, real t1, aabb& output_box) const override
     {
         if (_objects.empty())
         {
@@ -57,7 +66,7 @@ public:
         aabb temp_box {};
         bool first_box { true };
 
-        for (auto&& object : _objects)
+        for (const auto object : _objects)
         {
             if (!object->bounding_box(t0, t1, temp_box))
             {
@@ -71,11 +80,11 @@ public:
         return true;
     }
 
-    std::vector<shared_ptr<hittable>> objects() const
+    const std::vector<const hittable*>& objects() const noexcept
     {
         return _objects;
     }
 
 private:
-    std::vector<shared_ptr<hittable>> _objects;
+    std::vector<const hittable*> _objects;
 };
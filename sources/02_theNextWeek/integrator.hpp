@@ -0,0 +1,201 @@
+#pragma once
+
+#include "hittable.hpp"
+#include "light.hpp"
+#include "material.hpp"
+#include "pdf.hpp"
+#include "rtweekend.hpp"
+#include "sampler.hpp"
+#include "stats.hpp"
+
+#include <algorithm>
+
+/// @brief 积分器（路径追踪的实现方式）
+enum class integrator_mode
+{
+    recursive, // 每个样本递归追踪，有光源时按光源和BSDF的混合分布采样，见ray_color
+    wavefront, // 按批次逐次弹射，见render_wavefront
+    packet,    // 主光线按8x8的块一起求交，之后的弹射与recursive相同，见render_packets
+    iterative, // 循环追踪，对光源直接采样，用俄罗斯轮盘赌提前终止贡献小的路径，见path_color
+};
+
+/// @brief 光线没有击中任何物体时的颜色（天空的渐变色）
+inline vec3 background(const ray& r)
+{
+    vec3 unit_direction = unit_vector(r.direction());
+    auto t              = 0.5 * (unit_direction.y() + 1.0);
+    return (1.0 - t) * vec3(1.0, 1.0, 1.0) + t * vec3(0.5, 0.7, 1.0);
+}
+
+inline vec3 ray_color(const ray& r, const hittable& world, const material_table& materials, const light_list& lights, int depth);
+
+/// @brief 多重重要性采样的权重（幂启发式，指数为2），pdf_a是被加权的策略的概率密度
+inline real power_heuristic(real pdf_a, real pdf_b)
+{
+    const real a2 = pdf_a * pdf_a;
+    const real b2 = pdf_b * pdf_b;
+    return a2 / (a2 + b2);
+}
+
+/// @brief 已经求交的光线的颜色，击中时加上交点发出的光，按材质散射并继续追踪，否则取背景色
+/// 场景中有光源时，有概率密度的材质上以各一半的概率按光源或BSDF采样散射方向（mixture_pdf），
+/// 除以两者概率密度的平均，这样小光源的噪声也不大；没有光源时与书中相同，用scatter散射
+/// @param hit 光线是否击中物体，击中时rec是最近的交点
+/// @param depth 包括这条光线在内剩余的弹射次数
+inline vec3 shade(const ray& r, bool hit, const hit_record& rec, const hittable& world, const material_table& materials, const light_list& lights, int depth)
+{
+    if (hit)
+    {
+        const vec3 emitted = materials.emitted(rec);
+        if (!lights.empty() && materials.has_density(rec.material_id))
+        {
+            const mixture_pdf<light_pdf, material_pdf> mixture(light_pdf(lights, rec.p, r.time()), material_pdf(materials, r, rec), 0.5);
+
+            double xi[3];
+            thread_rng().fill(xi);
+            vec3 direction;
+            if (mixture.generate(xi, direction))
+            {
+                const real pdf = mixture.value(direction);
+                const vec3 f   = materials.eval(rec, -unit_vector(r.direction()), direction);
+                if (pdf > 0 && (f.x() > 0 || f.y() > 0 || f.z() > 0))
+                {
+                    return emitted + f / pdf * ray_color(ray(rec.p, direction, r.time()), world, materials, lights, depth - 1);
+                }
+            }
+
+            stats::count_path_end(path_end::absorbed);
+            return emitted;
+        }
+
+        ray scattered;
+        vec3 attenuation;
+        if (materials.scatter(r, rec, attenuation, scattered))
+        {
+            return emitted + attenuation * ray_color(scattered, world, materials, lights, depth - 1);
+        }
+
+        stats::count_path_end(path_end::absorbed);
+        return emitted;
+    }
+
+    stats::count_path_end(path_end::escaped);
+    return background(r);
+}
+
+inline vec3 ray_color(const ray& r, const hittable& world, const material_table& materials, const light_list& lights, int depth)
+{
+    const stats::bounce_scope scope;
+
+    hit_record rec;
+
+    // 如果达到了反射次数限制，则停止反射
+    // 此处返回的值其实就是阴影部分，可以将反射次数限制改小一点，观察渲染的结果
+    if (depth <= 0)
+    {
+        stats::count_path_end(path_end::depth_limit);
+        return vec3(0, 0, 0);
+    }
+
+    const bool hit = world.hit(r, 0.001, infinity, rec);
+    stats::count_ray(scope.bounce(), hit);
+
+    return shade(r, hit, rec, world, materials, lights, depth);
+}
+
+/// @brief 循环实现的路径追踪，期望与ray_color相同
+/// 记录路径的吞吐量（到目前为止衰减的乘积），弹射次数达到roulette_depth之后每次以p = min(1, 吞吐量的最大分量)的概率继续，
+/// 继续时吞吐量除以p，这样期望不变（俄罗斯轮盘赌）；反射率低的路径很快结束，玻璃等不衰减的路径不受影响
+/// 场景中有光源时，每次在有概率密度的材质（漫反射、光泽、模糊的金属）上对光源直接采样一个方向（next event estimation），
+/// 用阴影光线检查遮挡；散射的光线击中光源时，它发出的光与直接采样的结果用多重重要性采样（幂启发式）加权，
+/// 两种策略的权重之和为1。镜面反射和玻璃只靠散射的光线击中光源，权重为1
+/// @param lights 场景中的光源，为空时只按材质采样
+/// @param max_depth 最大弹射次数，与ray_color相同，达到时路径的贡献为0
+/// @param roulette_depth 前roulette_depth次弹射不使用俄罗斯轮盘赌
+/// @param samples 已经开始这个样本的采样器，每次弹射的光源采样、散射和轮盘赌使用sample_dimension::bounce分配的维度
+inline vec3 path_color(ray r, const hittable& world, const material_table& materials, const light_list& lights, int max_depth, int roulette_depth,
+                       sampler& samples)
+{
+    vec3 radiance(0, 0, 0);
+    vec3 throughput(1, 1, 1);
+    hit_record rec;
+
+    // 上一次散射的方向在立体角上的概率密度，为0时（主光线、镜面反射、玻璃）击中光源时不加权
+    real scatter_pdf = 0;
+    vec3 scatter_origin;
+
+    for (int bounce = 0; bounce < max_depth; ++bounce)
+    {
+        const bool hit = world.hit(r, 0.001, infinity, rec);
+        stats::count_ray(bounce, hit);
+
+        if (!hit)
+        {
+            stats::count_path_end(path_end::escaped);
+            return radiance + throughput * background(r);
+        }
+
+        const vec3 emitted = materials.emitted(rec);
+        if (emitted.x() > 0 || emitted.y() > 0 || emitted.z() > 0)
+        {
+            real weight = 1;
+            if (scatter_pdf > 0)
+            {
+                weight = power_heuristic(scatter_pdf, lights.pdf(scatter_origin, unit_vector(r.direction()), r.time()));
+            }
+            radiance += throughput * emitted * weight;
+        }
+
+        const vec3 wo            = -unit_vector(r.direction());
+        const bool sample_lights = !lights.empty() && materials.has_density(rec.material_id);
+        if (sample_lights)
+        {
+            double xi[3];
+            samples.get(sample_dimension::bounce(bounce, sample_dimension::light), xi);
+
+            light_sample light;
+            if (lights.sample(rec.p, r.time(), xi, light))
+            {
+                const vec3 f = materials.eval(rec, wo, light.direction);
+                if ((f.x() > 0 || f.y() > 0 || f.z() > 0) && !world.occluded(ray(rec.p, light.direction, r.time()), 0.001, light.distance - 0.001))
+                {
+                    // 权重与散射光线击中光源时一样使用所有光源合起来的概率密度，两种策略的权重之和才是1；
+                    // 估计值仍然除以实际采样这个光源的概率密度
+                    const real weight = power_heuristic(lights.pdf(rec.p, light.direction, r.time()), materials.pdf(rec, wo, light.direction));
+                    radiance += throughput * f * light.radiance * (weight / light.pdf);
+                }
+            }
+        }
+
+        double xi[3];
+        samples.get(sample_dimension::bounce(bounce, sample_dimension::scatter), xi);
+        scatter_sample scattered;
+        if (!materials.sample(r, rec, xi, scattered))
+        {
+            stats::count_path_end(path_end::absorbed);
+            return radiance;
+        }
+        throughput = throughput * scattered.weight;
+        r          = ray(rec.p, scattered.direction, r.time());
+
+        scatter_pdf    = sample_lights ? scattered.pdf : 0;
+        scatter_origin = rec.p;
+
+        if (bounce + 1 >= roulette_depth)
+        {
+            const double p = std::min(1.0, static_cast<double>(std::max({ throughput.x(), throughput.y(), throughput.z() })));
+            if (p < 1.0)
+            {
+                if (samples.get_1d(sample_dimension::bounce(bounce, sample_dimension::roulette)) >= p)
+                {
+                    stats::count_path_end(path_end::roulette);
+                    return radiance;
+                }
+                throughput = throughput / static_cast<real>(p);
+            }
+        }
+    }
+
+    stats::count_path_end(path_end::depth_limit);
+    return radiance;
+}
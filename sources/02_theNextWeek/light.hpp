@@ -0,0 +1,233 @@
+#pragma once
+
+#include "material.hpp"
+#include "pdf.hpp"
+#include "quad.hpp"
+#include "rtweekend.hpp"
+#include "sphere.hpp"
+#include "sphere_soa.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <span>
+#include <variant>
+#include <vector>
+
+/// @brief 在光源上采样得到的一个方向
+struct light_sample
+{
+    vec3 direction; // 从着色点指向光源上采样点的单位向量
+    real distance;  // 到采样点的距离，阴影光线只检查这个距离之内的遮挡
+    real pdf;       // 这个方向在立体角上的概率密度，包括选择这个光源的概率
+    vec3 radiance;  // 采样点向着色点发出的光
+};
+
+/// @brief 发光的球，index是球在sphere_soa中的下标，运动的球按光线的时刻取球心
+struct sphere_light
+{
+    uint32_t index;
+    vec3 emit;
+};
+
+/// @brief 发光的四边形，只向法线一侧发光
+struct quad_light
+{
+    const quad* shape;
+    vec3 emit;
+};
+
+/// @brief 面光源的种类，与material一样用std::variant按值存放
+using area_light = std::variant<sphere_light, quad_light>;
+
+/// @brief 场景中所有的面光源（材质是diffuse_light的球和四边形），用于直接光照采样（next event estimation）
+/// 每次采样先均匀地选择一个光源，再在光源上按立体角采样一个方向：
+/// 球在着色点看来是一个圆锥，在圆锥内均匀采样方向；四边形在面积上均匀采样一个点，再换算成立体角上的概率密度
+class light_list
+{
+public:
+    /// @brief 从场景中收集所有发光的物体，场景的物体改变之后要重新调用
+    void build(const sphere_soa& spheres, std::span<const quad* const> quads, const material_table& materials)
+    {
+        _spheres = &spheres;
+        _lights.clear();
+        for (size_t i = 0; i < spheres.size(); ++i)
+        {
+            if (const auto light = std::get_if<diffuse_light>(&materials[spheres.material(i)]))
+            {
+                _lights.push_back(sphere_light { static_cast<uint32_t>(i), light->emit });
+            }
+        }
+        for (const auto q : quads)
+        {
+            if (const auto light = std::get_if<diffuse_light>(&materials[q->material_id]))
+            {
+                _lights.push_back(quad_light { q, light->emit });
+            }
+        }
+    }
+
+    bool empty() const noexcept
+    {
+        return _lights.empty();
+    }
+
+    size_t size() const noexcept
+    {
+        return _lights.size();
+    }
+
+    /// @brief 从p点采样一个指向光源的方向
+    /// @param time 着色点所在光线的时刻
+    /// @param xi [0, 1)上的3个均匀分布的随机数，第一个选择光源，后两个在光源上采样
+    /// @return 采样失败（p在发光的球内、在四边形背面等）时返回false，这个样本的贡献为0
+    bool sample(const vec3& p, real time, const double xi[3], light_sample& out) const
+    {
+        const auto count = _lights.size();
+        const auto index = std::min(static_cast<size_t>(xi[0] * count), count - 1);
+
+        const bool valid = std::visit([&](const auto& light) { return sample_light(light, p, time, static_cast<real>(xi[1]), static_cast<real>(xi[2]), out); },
+                                      _lights[index]);
+        out.pdf /= static_cast<real>(count);
+        return valid && out.pdf > 0;
+    }
+
+    /// @brief 用sample从p点采样到单位向量direction的概率密度（立体角），用于多重重要性采样的权重
+    real pdf(const vec3& p, const vec3& direction, real time) const
+    {
+        real sum = 0;
+        for (const auto& light : _lights)
+        {
+            sum += std::visit([&](const auto& l) { return direction_pdf(l, p, direction, time); }, light);
+        }
+        return sum / static_cast<real>(_lights.size());
+    }
+
+private:
+    /// @brief 从p点看球所张的圆锥，返回1 - cos(圆锥的半角)，p在球内时返回0
+    static real cone_width(const vec3& p, const vec3& center, real radius) noexcept
+    {
+        const auto dist2 = (center - p).length_squared();
+        const auto r2    = radius * radius;
+        if (dist2 <= r2)
+        {
+            return 0;
+        }
+        // 1 - cos = sin^2 / (1 + cos)，小光源时避免两个接近的数相减
+        const auto sin2_max = r2 / dist2;
+        const auto cos_max  = std::sqrt(std::max(real(0), 1 - sin2_max));
+        return sin2_max / (1 + cos_max);
+    }
+
+    bool sample_light(const sphere_light& light, const vec3& p, real time, real u0, real u1, light_sample& out) const
+    {
+        const vec3 center = _spheres->center(light.index, time);
+        const real radius = _spheres->radius(light.index);
+        const real width  = cone_width(p, center, radius);
+        out.pdf           = 0;
+        if (width <= 0)
+        {
+            return false;
+        }
+
+        // 圆锥内均匀采样方向
+        const vec3 to_center  = center - p;
+        const real dist       = to_center.length();
+        const real cos_theta  = 1 - u0 * width;
+        const real sin2_theta = std::max(real(0), 1 - cos_theta * cos_theta);
+        const real phi        = 2 * pi * u1;
+
+        const vec3 w = to_center / dist;
+        vec3 a, b;
+        orthonormal_basis(w, a, b);
+        const real sin_theta = std::sqrt(sin2_theta);
+        out.direction        = sin_theta * std::cos(phi) * a + sin_theta * std::sin(phi) * b + cos_theta * w;
+
+        // 方向与球的近交点的距离，从球外看到的总是球的正面
+        const real discriminant = radius * radius - dist * dist * sin2_theta;
+        out.distance            = dist * cos_theta - std::sqrt(std::max(real(0), discriminant));
+        out.pdf                 = 1 / (2 * pi * width);
+        out.radiance            = light.emit;
+        return true;
+    }
+
+    bool sample_light(const quad_light& light, const vec3& p, real time, real u0, real u1, light_sample& out) const
+    {
+        const vec3 to_light = light.shape->point(u0, u1) - p;
+        const real dist2    = to_light.length_squared();
+        out.distance        = std::sqrt(dist2);
+        out.direction       = to_light / out.distance;
+        out.pdf             = 0;
+
+        // 只有法线一侧发光
+        const real cos_light = -dot(out.direction, light.shape->normal);
+        if (cos_light <= 0)
+        {
+            return false;
+        }
+        out.pdf      = dist2 / (cos_light * light.shape->area);
+        out.radiance = light.emit;
+        return true;
+    }
+
+    real direction_pdf(const sphere_light& light, const vec3& p, const vec3& direction, real time) const
+    {
+        const vec3 center = _spheres->center(light.index, time);
+        const real radius = _spheres->radius(light.index);
+        const real width  = cone_width(p, center, radius);
+        if (width <= 0 || !hit_sphere(ray(p, direction, time), center, radius, 0, infinity))
+        {
+            return 0;
+        }
+        return 1 / (2 * pi * width);
+    }
+
+    real direction_pdf(const quad_light& light, const vec3& p, const vec3& direction, real time) const
+    {
+        hit_record rec;
+        if (!light.shape->hit(ray(p, direction, time), 0, infinity, rec) || !rec.front_face)
+        {
+            return 0;
+        }
+        const real cos_light = -dot(direction, light.shape->normal);
+        return rec.t * rec.t / (cos_light * light.shape->area);
+    }
+
+    const sphere_soa* _spheres { nullptr };
+    std::vector<area_light> _lights;
+};
+
+/// @brief 指向光源的分布，见light_list::sample和light_list::pdf
+class light_pdf
+{
+public:
+    /// @param time 光线的时刻，运动的发光球按这个时刻取球心
+    light_pdf(const light_list& lights, const vec3& origin, real time) noexcept
+        : _lights(lights)
+        , _origin(origin)
+        , _time(time)
+    {
+    }
+
+    /// @brief 使用xi的三个数，p在发光球内、在四边形背面时返回false
+    bool generate(const double xi[3], vec3& direction) const
+    {
+        light_sample sample;
+        if (!_lights.sample(_origin, _time, xi, sample))
+        {
+            return false;
+        }
+        direction = sample.direction;
+        return true;
+    }
+
+    real value(const vec3& direction) const
+    {
+        return _lights.pdf(_origin, direction, _time);
+    }
+
+private:
+    const light_list& _lights;
+    vec3 _origin;
+    real _time;
+};
@@ -1,83 +1,22 @@
 #include "bvh.hpp"
 #include "camera.hpp"
+#include "flat_bvh.hpp"
 #include "hittable_list.hpp"
+#include "integrator.hpp"
 #include "material.hpp"
+#include "options.hpp"
+#include "packet.hpp"
+#include "renderer.hpp"
+#include "scene_file.hpp"
 #include "rtweekend.hpp"
+#include "scenes.hpp"
 #include "sphere.hpp"
+#include "sphere_soa.hpp"
+#include "stats.hpp"
+#include "wavefront.hpp"
 
-vec3 ray_color(const ray& r, const hittable& world, int depth)
-{
-    hit_record rec;
-
-    // 如果达到了反射次数限制，则停止反射
-    // 此处返回的值其实就是阴影部分，可以将反射次数限制改小一点，观察渲染的结果
-    if (depth <= 0)
-        return vec3(0, 0, 0);
-
-    if (world.hit(r, 0.001, infinity, rec))
-    {
-        ray scattered;
-        vec3 attenuation;
-        if (rec.mat_ptr->scatter(r, rec, attenuation, scattered))
-        {
-            return attenuation * ray_color(scattered, world, depth - 1);
-        }
-
-        return vec3(0, 0, 0);
-    }
-
-    vec3 unit_direction = unit_vector(r.direction());
-    auto t              = 0.5 * (unit_direction.y() + 1.0);
-    return (1.0 - t) * vec3(1.0, 1.0, 1.0) + t * vec3(0.5, 0.7, 1.0);
-}
-
-hittable_list random_scene()
-{
-    hittable_list world;
-
-    world.add(make_shared<sphere>(vec3(0, -1000, 0), 1000, make_shared<lambertian>(vec3(0.5, 0.5, 0.5))));
-
-    int i = 1;
-    for (int a = -10; a < 10; a++)
-    {
-        for (int b = -10; b < 10; b++)
-        {
-            auto choose_mat = random_double();
-            vec3 center(a + 0.9 * random_double(), 0.2, b + 0.9 * random_double());
-            if ((center - vec3(4, .2, 0)).length() > 0.9)
-            {
-                if (choose_mat < 0.8)
-                {
-                    // diffuse
-                    auto albedo = vec3::random() * vec3::random();
-                    world.add(make_shared<moving_sphere>(
-                        center, center + vec3(0, random_double(0, .5), 0), 0.0, 1.0, 0.2, make_shared<lambertian>(albedo)));
-                }
-                else if (choose_mat < 0.95)
-                {
-                    // metal
-                    auto albedo = vec3::random(.5, 1);
-                    auto fuzz   = random_double(0, .5);
-                    world.add(make_shared<sphere>(center, 0.2, make_shared<metal>(albedo, fuzz)));
-                }
-                else
-                {
-                    // glass
-                    world.add(make_shared<sphere>(center, 0.2, make_shared<dielectric>(1.5)));
-                }
-            }
-        }
-    }
-
-    world.add(make_shared<sphere>(vec3(0, 1, 0), 1.0, make_shared<dielectric>(1.5)));
-    world.add(make_shared<sphere>(vec3(-4, 1, 0), 1.0, make_shared<lambertian>(vec3(0.4, 0.2, 0.1))));
-    world.add(make_shared<sphere>(vec3(4, 1, 0), 1.0, make_shared<metal>(vec3(0.7, 0.6, 0.5), 0.0)));
-
-    // 使用bvh优化
-    return static_cast<hittable_list>(make_shared<bvh_node>(world, 0., 1.));
-
-    //return world;
-}
+#include <string>
+#include <string_view>
 
 /// @brief 计算耗时
 class TimeCounter
@@ -95,63 +34,183 @@ private:
     std::chrono::steady_clock::time_point start { std::chrono::steady_clock::now() };
 };
 
-int main()
+/// @brief 比较两幅图像（P6或PFM），输出误差报告，用于检查float渲染与double渲染的差别
+/// @return 读取失败或者两幅图像大小不同时返回1，脚本可以用返回值判断能否比较
+int compare(const std::string& path_a, const std::string& path_b)
 {
-    TimeCounter counter;
+    framebuffer a, b;
+    if (!a.load(path_a) || !b.load(path_b))
+    {
+        std::cerr << "Failed to read " << path_a << " or " << path_b << '\n';
+        return 1;
+    }
+    if (a.width() != b.width() || a.height() != b.height())
+    {
+        std::cerr << "Image sizes differ: " << a.width() << 'x' << a.height() << " and " << b.width() << 'x' << b.height() << '\n';
+        return 1;
+    }
+
+    const auto error = compare_images(a, b);
+    std::cout << "RMSE (linear): " << error.rmse_linear << '\n'
+              << "RMSE (8-bit):  " << error.rmse_8bit << '\n'
+              << "Max (8-bit):   " << error.max_8bit << '\n'
+              << "PSNR:          " << error.psnr << " dB\n";
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc == 4 && std::string_view(argv[1]) == "compare")
+    {
+        return compare(argv[2], argv[3]);
+    }
+
+    // 分辨率、样本数、场景等都由命令行参数指定，见print_usage
+    render_options options;
+    std::string error;
+    if (!parse_options(argc, argv, options, error))
+    {
+        std::cerr << error << '\n';
+        print_usage(std::cerr, argv[0]);
+        return 1;
+    }
+    if (options.help)
+    {
+        print_usage(std::cout, argv[0]);
+        return 0;
+    }
 
-    const int image_width       = 200;
-    const int image_height      = 100;
-    const int samples_per_pixel = 100;
-    const int max_depth         = 50; // 反射的最大次数
+    const auto& settings = options.settings;
+    const int max_depth  = options.max_depth;
+    const auto& output   = options.output;
+    const auto format    = options.format.value_or(image_format_from_path(output));
 
-    std::cout << "P3\n" << image_width << " " << image_height << "\n255\n";
+    TimeCounter counter;
 
+    // arena objects;
     // hittable_list world;
 
-    // world.add(make_shared<sphere>(vec3(0, 0, -1), 0.5, make_shared<lambertian>(vec3(0.7, 0., 0.))));
-    // world.add(make_shared<sphere>(vec3(0, -100.5, -1), 100, make_shared<lambertian>(vec3(0.8, 0.8, 0.0))));
-    // world.add(make_shared<sphere>(vec3(1, 0, -1), 0.5, make_shared<metal>(vec3(0.8, 0.6, 0.2), 0.3)));
-    // world.add(make_shared<sphere>(vec3(-1, 0, -1), 0.5, make_shared<metal>(vec3(0.8, 0.8, 0.8), 0.0)));
+    // world.add(objects.make<sphere>(vec3(0, 0, -1), 0.5, materials.add(lambertian(vec3(0.7, 0., 0.)))));
+    // world.add(objects.make<sphere>(vec3(0, -100.5, -1), 100, materials.add(lambertian(vec3(0.8, 0.8, 0.0)))));
+    // world.add(objects.make<sphere>(vec3(1, 0, -1), 0.5, materials.add(metal(vec3(0.8, 0.6, 0.2), 0.3))));
+    // world.add(objects.make<sphere>(vec3(-1, 0, -1), 0.5, materials.add(metal(vec3(0.8, 0.8, 0.8), 0.0))));
 
-    // world.add(make_shared<sphere>(vec3(0, 0, -1), 0.5, make_shared<lambertian>(vec3(0.1, 0.2, 0.5))));
-    // world.add(make_shared<sphere>(vec3(0, -100.5, -1), 100, make_shared<lambertian>(vec3(0.8, 0.8, 0.0))));
-    // world.add(make_shared<sphere>(vec3(1, 0, -1), 0.5, make_shared<metal>(vec3(0.8, 0.6, 0.2), 0.3)));
-    // world.add(make_shared<sphere>(vec3(-1, 0, -1), 0.5, make_shared<dielectric>(1.5)));
+    // world.add(objects.make<sphere>(vec3(0, 0, -1), 0.5, materials.add(lambertian(vec3(0.1, 0.2, 0.5)))));
+    // world.add(objects.make<sphere>(vec3(0, -100.5, -1), 100, materials.add(lambertian(vec3(0.8, 0.8, 0.0)))));
+    // world.add(objects.make<sphere>(vec3(1, 0, -1), 0.5, materials.add(metal(vec3(0.8, 0.6, 0.2), 0.3))));
+    // world.add(objects.make<sphere>(vec3(-1, 0, -1), 0.5, materials.add(dielectric(1.5))));
     // // 加入一个法相指向球内部的球，这个球被上面这个球包裹，就可以渲染一个通透的玻璃球
-    // world.add(make_shared<sphere>(vec3(-1, 0, -1), -0.49, make_shared<dielectric>(1.5)));
+    // world.add(objects.make<sphere>(vec3(-1, 0, -1), -0.49, materials.add(dielectric(1.5))));
 
     // auto R = cos(pi / 4);
-    // world.add(make_shared<sphere>(vec3(-R, 0, -1), R, make_shared<lambertian>(vec3(0, 0, 1))));
-    // world.add(make_shared<sphere>(vec3(R, 0, -1), R, make_shared<lambertian>(vec3(1, 0, 0))));
+    // world.add(objects.make<sphere>(vec3(-R, 0, -1), R, materials.add(lambertian(vec3(0, 0, 1)))));
+    // world.add(objects.make<sphere>(vec3(R, 0, -1), R, materials.add(lambertian(vec3(1, 0, 0)))));
+
+    // 相同的种子生成相同的场景和图像
+    seed_random(settings.seed);
+    scene world_scene;
+    if (!make_scene(options.scene, world_scene))
+    {
+        // 不是内置场景的名字时作为场景文件加载
+        const auto start = std::chrono::steady_clock::now();
+        if (!load_scene(options.scene, world_scene, error))
+        {
+            std::cerr << "Failed to load scene " << options.scene << ": " << error << '\n';
+            return 1;
+        }
+        const std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        std::clog << "Loaded " << world_scene.spheres->size() << " spheres in " << elapsed.count() << " ms\n";
+    }
+    world_scene.lookfrom   = options.lookfrom.value_or(world_scene.lookfrom);
+    world_scene.lookat     = options.lookat.value_or(world_scene.lookat);
+    world_scene.vfov       = options.vfov.value_or(world_scene.vfov);
+    world_scene.aperture   = options.aperture.value_or(world_scene.aperture);
+    world_scene.focus_dist = options.focus_dist.value_or(world_scene.focus_dist);
+    if (!world_scene.valid_camera(error))
+    {
+        std::cerr << "Invalid camera: " << error << '\n';
+        return 1;
+    }
+
+    if (!options.save_scene.empty())
+    {
+        if (!save_scene(world_scene, options.save_scene))
+        {
+            std::cerr << "Failed to write " << options.save_scene << '\n';
+            return 1;
+        }
+        std::clog << "Saved " << options.save_scene << '\n';
+        return 0;
+    }
+
+    // 使用bvh优化，sphere_soa内部是一棵flat_bvh，默认使用SAH构建；指定了缓存目录时相同的场景直接映射上次构建的结果
+    const auto build_start = std::chrono::steady_clock::now();
+    bool cached            = false;
+    if (options.bvh_cache.empty())
+    {
+        world_scene.build();
+    }
+    else
+    {
+        cached = world_scene.build_cached(options.bvh_cache);
+    }
+    const std::chrono::duration<double, std::milli> build_time = std::chrono::steady_clock::now() - build_start;
+    std::clog << (cached ? "BVH loaded from cache in " : "BVH built in ") << build_time.count() << " ms\n";
+    std::clog << "BVH nodes: " << world_scene.spheres->node_count() << ", SAH cost: " << world_scene.spheres->sah_cost() << '\n';
+
+    // 由单独对象组成的场景可以使用flat_bvh或者bvh_node
+    //hittable_list world(world_scene.objects.make<flat_bvh>(list, 0., 1.));
+    //hittable_list world(world_scene.objects.make<bvh_node>(world_scene.objects, list, 0., 1.));
 
-    auto world = random_scene();
+    const hittable_list world = world_scene.world();
+    const auto& materials     = world_scene.materials;
 
-    const auto aspect_ratio = double(image_width) / image_height;
+    const auto aspect_ratio = double(settings.image_width) / settings.image_height;
 
-    vec3 lookfrom(13, 2, 3);
-    vec3 lookat(0, 0, 0);
-    vec3 vup(0, 1, 0);
-    auto dist_to_focus = 10.0;
-    auto aperture      = 0.0;
+    camera cam = world_scene.make_camera(aspect_ratio);
 
-    camera cam(lookfrom, lookat, vup, 20, aspect_ratio, aperture, dist_to_focus, 0.0, 1.0);
+    stats::begin_frame(settings.image_width, settings.image_height);
 
-    for (int j = image_height - 1; j >= 0; --j)
+    // recursive和iterative逐个样本计算颜色，期望相同，iterative对光源直接采样
+    // 采样器提供像素、镜头和时间的随机数，iterative的每次弹射也使用采样器，recursive的弹射使用伪随机数
+    const auto sample = [&](double u, double v, sampler& samples) {
+        const ray r = cam.get_ray(u, v, samples);
+        return options.integrator == integrator_mode::iterative ? path_color(r, world, materials, world_scene.lights, max_depth, options.roulette_depth, samples)
+                                                                : ray_color(r, world, materials, world_scene.lights, max_depth);
+    };
+
+    framebuffer image;
+    if (options.integrator == integrator_mode::wavefront)
     {
-        std::cerr << "\rScanlines remaining: " << j << ' ' << std::flush;
-        for (int i = 0; i < image_width; ++i)
-        {
-            vec3 color(0, 0, 0);
-            for (int s = 0; s < samples_per_pixel; ++s)
-            {
-                auto u = (i + random_double()) / image_width;
-                auto v = (j + random_double()) / image_height;
-                ray r  = cam.get_ray(u, v);
-                color += ray_color(r, world, max_depth);
-            }
-            color.write_color(std::cout, samples_per_pixel);
-        }
+        image = render_wavefront(settings, cam, world, materials, max_depth);
+    }
+    else if (options.integrator == integrator_mode::packet)
+    {
+        image = render_packets(settings, cam, *world_scene.spheres, world_scene.surfaces(), world, materials, world_scene.lights, max_depth);
+    }
+    else if (options.adaptive)
+    {
+        // 总样本数不超过固定采样，每隔--preview-interval轮覆盖写出一次中间结果
+        image = render_progressive(settings, options.progressive, sample, [&](const framebuffer& preview, int pass) { preview.save(output, format); });
+    }
+    else
+    {
+        image = render_tiles(settings, sample);
     }
 
-    std::cerr << "\nDone.\n";
+    // 渲染结束后一次写出整幅图像，工作线程不访问输出流
+    if (!image.save(output, format))
+    {
+        std::cerr << "\nFailed to write " << output << '\n';
+        return 1;
+    }
+
+    std::cerr << "\nDone. Saved " << output << '\n';
+
+    // 打开RT_ENABLE_STATS时输出遍历和着色的统计，每个像素遍历代价的热力图写入heatmap.png
+    if constexpr (stats::enabled)
+    {
+        stats::frame().print(std::clog);
+        stats::heatmap().save("heatmap.png");
+    }
 }
\ No newline at end of file
@@ -0,0 +1,154 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/// @brief 只读的内存映射文件，文件内容按需由操作系统换入，打开大文件不需要复制
+class mapped_file
+{
+public:
+    mapped_file() noexcept = default;
+
+    mapped_file(const mapped_file&)            = delete;
+    mapped_file& operator=(const mapped_file&) = delete;
+
+    mapped_file(mapped_file&& other) noexcept
+        : _data(std::exchange(other._data, nullptr))
+        , _size(std::exchange(other._size, 0))
+    {
+    }
+
+    mapped_file& operator=(mapped_file&& other) noexcept
+    {
+        if (this != &other)
+        {
+            close();
+            _data = std::exchange(other._data, nullptr);
+            _size = std::exchange(other._size, 0);
+        }
+        return *this;
+    }
+
+    ~mapped_file() noexcept
+    {
+        close();
+    }
+
+    /// @brief 映射整个文件，空文件也算成功（data为空）
+    /// @return 文件不存在或者映射失败时返回false
+    bool open(const std::string& path)
+    {
+        close();
+
+#if defined(_WIN32)
+        HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+        {
+            return false;
+        }
+
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(file, &size))
+        {
+            CloseHandle(file);
+            return false;
+        }
+        if (size.QuadPart == 0)
+        {
+            CloseHandle(file);
+            return true;
+        }
+
+        HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        CloseHandle(file);
+        if (mapping == nullptr)
+        {
+            return false;
+        }
+
+        void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        CloseHandle(mapping);
+        if (view == nullptr)
+        {
+            return false;
+        }
+
+        _data = static_cast<const uint8_t*>(view);
+        _size = static_cast<size_t>(size.QuadPart);
+#else
+        const int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            return false;
+        }
+
+        struct stat st;
+        if (fstat(fd, &st) != 0)
+        {
+            ::close(fd);
+            return false;
+        }
+        if (st.st_size == 0)
+        {
+            ::close(fd);
+            return true;
+        }
+
+        void* view = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (view == MAP_FAILED)
+        {
+            return false;
+        }
+
+        _data = static_cast<const uint8_t*>(view);
+        _size = static_cast<size_t>(st.st_size);
+#endif
+        return true;
+    }
+
+    void close() noexcept
+    {
+        if (_data == nullptr)
+        {
+            return;
+        }
+
+#if defined(_WIN32)
+        UnmapViewOfFile(_data);
+#else
+        munmap(const_cast<uint8_t*>(_data), _size);
+#endif
+        _data = nullptr;
+        _size = 0;
+    }
+
+    /// @brief 映射的起始地址，按页对齐
+    const uint8_t* data() const noexcept
+    {
+        return _data;
+    }
+
+    size_t size() const noexcept
+    {
+        return _size;
+    }
+
+private:
+    const uint8_t* _data { nullptr };
+    size_t _size { 0 };
+};
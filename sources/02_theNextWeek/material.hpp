@@ -1,17 +1,31 @@
 #pragma once
 
+#include "hittable.hpp"
+#include "pdf.hpp"
 #include "rtweekend.hpp"
 
-struct hit_record;
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <variant>
+#include <vector>
 
-class material
+/// @brief 材质按BSDF采样得到的散射方向
+/// 除了scatter，材质还可以提供：
+///     bool sample(r_in, rec, xi, out)  用[0, 1)上的3个随机数采样散射方向
+///     vec3 eval(rec, wo, wi)           BSDF乘以cos(wi, 法线)，wo指向观察者，wi指向光的来源，都是单位向量
+///     real pdf(rec, wo, wi)            sample生成wi的概率密度（立体角）
+/// 镜面反射（specular返回true）的方向是确定的，没有概率密度，不能与光源采样组合
+struct scatter_sample
 {
-public:
-    virtual bool scatter(const ray& r_in, const hit_record& rec, vec3& attenuation, ray& scattered) const = 0;
+    vec3 direction; // 单位向量
+    vec3 weight;    // eval / pdf，镜面反射时是衰减
+    real pdf;       // 镜面反射时为0
+    bool specular;
 };
 
 // 漫反射材质
-class lambertian : public material
+class lambertian
 {
 public:
     lambertian(const vec3& a)
@@ -19,7 +33,7 @@ public:
     {
     }
 
-    virtual bool scatter(const ray& r_in, const hit_record& rec, vec3& attenuation, ray& scattered) const
+    bool scatter(const ray& r_in, const hit_record& rec, vec3& attenuation, ray& scattered) const
     {
         // 散射方向
         vec3 scatter_direction = rec.normal + random_unit_vector();
@@ -34,21 +48,42 @@ public:
         return true;
     }
 
+    /// @brief 按余弦分布采样，与scatter的分布相同，eval / pdf = albedo
+    bool sample(const ray& r_in, const hit_record& rec, const double xi[3], scatter_sample& out) const
+    {
+        const cosine_pdf lobe(rec.normal);
+        lobe.generate(xi, out.direction);
+        out.pdf      = lobe.value(out.direction);
+        out.weight   = albedo;
+        out.specular = false;
+        return out.pdf > 0;
+    }
+
+    vec3 eval(const hit_record& rec, const vec3& wo, const vec3& wi) const
+    {
+        return albedo * (std::max(real(0), dot(wi, rec.normal)) / pi);
+    }
+
+    real pdf(const hit_record& rec, const vec3& wo, const vec3& wi) const
+    {
+        return cosine_pdf(rec.normal).value(wi);
+    }
+
 public:
     vec3 albedo;
 };
 
 // 金属材质，发生反射
-class metal : public material
+class metal
 {
 public:
-    metal(const vec3& a, double f)
+    metal(const vec3& a, real f)
         : albedo(a)
         , fuzz(f < 1 ? f : 1)
     {
     }
 
-    virtual bool scatter(const ray& r_in, const hit_record& rec, vec3& attenuation, ray& scattered) const
+    bool scatter(const ray& r_in, const hit_record& rec, vec3& attenuation, ray& scattered) const
     {
         vec3 reflected = reflect(unit_vector(r_in.direction()), rec.normal);
         scattered      = ray(rec.p, reflected + fuzz * random_in_unit_sphere());
@@ -56,28 +91,84 @@ public:
         return (dot(scattered.direction(), rec.normal) > 0); // dot<0我们认为吸收
     }
 
+    /// @brief 与scatter的分布相同：反射方向加上半径为fuzz的球内均匀分布的偏移，再归一化
+    bool sample(const ray& r_in, const hit_record& rec, const double xi[3], scatter_sample& out) const
+    {
+        const vec3 reflected = reflect(unit_vector(r_in.direction()), rec.normal);
+
+        // 单位球内均匀分布的点：方向在球面上均匀分布，半径是xi[2]的立方根
+        const real z      = 1 - 2 * static_cast<real>(xi[0]);
+        const real radial = std::sqrt(std::max(real(0), 1 - z * z));
+        const real phi    = 2 * pi * xi[1];
+        const real radius = std::cbrt(static_cast<real>(xi[2]));
+        const vec3 offset = radius * vec3(radial * std::cos(phi), radial * std::sin(phi), z);
+
+        out.direction = unit_vector(reflected + fuzz * offset);
+        out.weight    = albedo;
+        out.specular  = specular();
+        out.pdf       = out.specular ? 0 : pdf(rec, -unit_vector(r_in.direction()), out.direction);
+        return dot(out.direction, rec.normal) > 0;
+    }
+
+    /// @brief 表面以上的方向eval / pdf = albedo
+    vec3 eval(const hit_record& rec, const vec3& wo, const vec3& wi) const
+    {
+        return albedo * pdf(rec, wo, wi);
+    }
+
+    /// @brief 方向wi的射线穿过以反射方向为球心、半径为fuzz的球，球内沿射线s到s + ds的体积是s^2 ds乘以立体角，
+    /// 所以概率密度是(s2^3 - s1^3) / 3 / 球的体积，s1、s2是射线与球的两个交点
+    real pdf(const hit_record& rec, const vec3& wo, const vec3& wi) const
+    {
+        if (specular() || dot(wi, rec.normal) <= 0)
+        {
+            return 0;
+        }
+        const vec3 reflected    = reflect(-wo, rec.normal);
+        const real b            = dot(wi, reflected);
+        const real discriminant = b * b - (1 - fuzz * fuzz);
+        if (discriminant <= 0)
+        {
+            return 0;
+        }
+        const real root = std::sqrt(discriminant);
+        const real s2   = b + root;
+        const real s1   = std::max(real(0), b - root);
+        if (s2 <= 0)
+        {
+            return 0;
+        }
+        return (s2 * s2 * s2 - s1 * s1 * s1) / (4 * pi * fuzz * fuzz * fuzz);
+    }
+
+    /// @brief 没有模糊的金属是镜面反射
+    bool specular() const noexcept
+    {
+        return fuzz <= 0;
+    }
+
 public:
     vec3 albedo;
-    double fuzz; // 金属的模糊度（粗糙度），当fuzz等于0时不会产生模糊
+    real fuzz; // 金属的模糊度（粗糙度），当fuzz等于0时不会产生模糊
 };
 
 // 绝缘体材质，只会发生折射
-class dielectric : public material
+class dielectric
 {
 public:
-    dielectric(double ri)
+    dielectric(real ri)
         : ref_idx(ri)
     {
     }
 
-    virtual bool scatter(const ray& r_in, const hit_record& rec, vec3& attenuation, ray& scattered) const
+    bool scatter(const ray& r_in, const hit_record& rec, vec3& attenuation, ray& scattered) const
     {
-        attenuation           = vec3(1.0, 1.0, 1.0); // 光线衰减为1，即不衰减
-        double etai_over_etat = (rec.front_face) ? (1.0 / ref_idx) : (ref_idx);
+        attenuation         = vec3(1.0, 1.0, 1.0); // 光线衰减为1，即不衰减
+        real etai_over_etat = (rec.front_face) ? (1.0 / ref_idx) : (ref_idx);
 
         vec3 unit_direction = unit_vector(r_in.direction());
-        double cos_theta    = ffmin(dot(-unit_direction, rec.normal), 1.0);
-        double sin_theta    = sqrt(1.0 - cos_theta * cos_theta);
+        real cos_theta      = ffmin(dot(-unit_direction, rec.normal), real(1));
+        real sin_theta      = sqrt(1.0 - cos_theta * cos_theta);
 
         // 无法发生折射的时候，发生反射
         if (etai_over_etat * sin_theta > 1.0)
@@ -88,7 +179,7 @@ public:
         }
 
         // 当从很窄的监督去看玻璃窗，它会变为一面镜子，发生反射
-        double reflect_prob = schlick(cos_theta, etai_over_etat);
+        real reflect_prob = schlick(cos_theta, etai_over_etat);
         if (random_double() < reflect_prob)
         {
             vec3 reflected = reflect(unit_direction, rec.normal);
@@ -102,6 +193,337 @@ public:
         return true;
     }
 
+    /// @brief 与scatter相同，xi[0]决定是否反射
+    bool sample(const ray& r_in, const hit_record& rec, const double xi[3], scatter_sample& out) const
+    {
+        real etai_over_etat = (rec.front_face) ? (1.0 / ref_idx) : (ref_idx);
+
+        vec3 unit_direction = unit_vector(r_in.direction());
+        real cos_theta      = ffmin(dot(-unit_direction, rec.normal), real(1));
+        real sin_theta      = sqrt(1.0 - cos_theta * cos_theta);
+
+        if (etai_over_etat * sin_theta > 1.0 || xi[0] < schlick(cos_theta, etai_over_etat))
+        {
+            out.direction = reflect(unit_direction, rec.normal);
+        }
+        else
+        {
+            out.direction = refract(unit_direction, rec.normal, etai_over_etat);
+        }
+        out.weight   = vec3(1.0, 1.0, 1.0);
+        out.pdf      = 0;
+        out.specular = true;
+        return true;
+    }
+
+    bool specular() const noexcept
+    {
+        return true;
+    }
+
+public:
+    real ref_idx;
+};
+
+// 光泽材质：漫反射的底色上有一层透明涂层（类似塑料），涂层是GGX微表面，反射率F0 = 0.04
+// 按两个波瓣的混合采样：以specular_probability的概率按GGX采样，否则按余弦分布采样
+class glossy
+{
 public:
-    double ref_idx;
+    static constexpr real coat_reflectance     = 0.04;
+    static constexpr real specular_probability = 0.5;
+
+    glossy(const vec3& a, real r)
+        : albedo(a)
+        , roughness(r)
+    {
+    }
+
+    bool scatter(const ray& r_in, const hit_record& rec, vec3& attenuation, ray& scattered) const
+    {
+        double xi[3];
+        thread_rng().fill(xi);
+
+        scatter_sample s;
+        if (!sample(r_in, rec, xi, s))
+        {
+            return false;
+        }
+        attenuation = s.weight;
+        scattered   = ray(rec.p, s.direction, r_in.time());
+        return true;
+    }
+
+    bool sample(const ray& r_in, const hit_record& rec, const double xi[3], scatter_sample& out) const
+    {
+        const vec3 wo    = -unit_vector(r_in.direction());
+        const auto lobes = lobe_pdf(rec, wo);
+        if (!lobes.generate(xi, out.direction))
+        {
+            return false;
+        }
+        out.pdf      = lobes.value(out.direction);
+        out.specular = false;
+        if (out.pdf <= 0)
+        {
+            return false;
+        }
+        out.weight = eval(rec, wo, out.direction) / out.pdf;
+        return true;
+    }
+
+    /// @brief 涂层的Cook-Torrance项D * G * F / (4 * cos_i * cos_o)加上Ashikhmin-Shirley的漫反射项，
+    /// 后者考虑了两次穿过涂层时被反射掉的光，掠射时总的反射率也不超过1
+    vec3 eval(const hit_record& rec, const vec3& wo, const vec3& wi) const
+    {
+        const real cos_i = dot(wi, rec.normal);
+        const real cos_o = dot(wo, rec.normal);
+        if (cos_i <= 0 || cos_o <= 0)
+        {
+            return vec3(0, 0, 0);
+        }
+
+        const real a        = alpha();
+        const vec3 h        = unit_vector(wo + wi);
+        const real d        = ggx_distribution(dot(h, rec.normal), a);
+        const real g        = ggx_smith_g1(cos_i, a) * ggx_smith_g1(cos_o, a);
+        const real f        = coat_reflectance + (1 - coat_reflectance) * std::pow(1 - std::max(real(0), dot(wi, h)), real(5));
+        const real specular = d * g * f / (4 * cos_i * cos_o);
+        const real diffuse  = 28 / (23 * pi) * (1 - coat_reflectance) * (1 - std::pow(1 - cos_i / 2, real(5))) * (1 - std::pow(1 - cos_o / 2, real(5)));
+        return (albedo * diffuse + vec3(specular, specular, specular)) * cos_i;
+    }
+
+    real pdf(const hit_record& rec, const vec3& wo, const vec3& wi) const
+    {
+        return lobe_pdf(rec, wo).value(wi);
+    }
+
+public:
+    vec3 albedo;
+    real roughness; // 0（光滑）到1（粗糙），GGX的alpha = roughness^2
+
+private:
+    real alpha() const noexcept
+    {
+        return std::max(roughness * roughness, real(1e-3));
+    }
+
+    mixture_pdf<ggx_pdf, cosine_pdf> lobe_pdf(const hit_record& rec, const vec3& wo) const
+    {
+        return mixture_pdf<ggx_pdf, cosine_pdf>(ggx_pdf(rec.normal, wo, alpha()), cosine_pdf(rec.normal), specular_probability);
+    }
+};
+
+// 发光材质（面光源），只有正面发光，不散射光线
+class diffuse_light
+{
+public:
+    diffuse_light(const vec3& e)
+        : emit(e)
+    {
+    }
+
+    bool scatter(const ray& r_in, const hit_record& rec, vec3& attenuation, ray& scattered) const
+    {
+        return false;
+    }
+
+    /// @brief 交点处向入射光线反方向发出的辐射亮度，从背面看是黑的
+    vec3 emitted(const hit_record& rec) const
+    {
+        return rec.front_face ? emit : vec3(0, 0, 0);
+    }
+
+public:
+    vec3 emit;
+};
+
+/// @brief 封闭的材质集合，新增材质时在这里添加类型，并在material_kind中添加对应的枚举值
+/// 材质按值存放在material_table中，hit_record只记录材质下标，不需要虚函数调用和引用计数
+using material = std::variant<lambertian, metal, dielectric, diffuse_light, glossy>;
+
+/// @brief 材质的具体类型，与material中类型的顺序相同，用于按材质分组着色
+enum class material_kind : uint32_t
+{
+    lambertian,
+    metal,
+    dielectric,
+    diffuse_light,
+    glossy,
+};
+
+inline constexpr size_t material_kind_count = std::variant_size_v<material>;
+
+/// @brief 材质发出的光，没有emitted的材质不发光
+template <typename Material>
+inline vec3 material_emitted(const Material& m, const hit_record& rec)
+{
+    if constexpr (requires { m.emitted(rec); })
+    {
+        return m.emitted(rec);
+    }
+    else
+    {
+        return vec3(0, 0, 0);
+    }
+}
+
+/// @brief 材质的BSDF是否有概率密度（不是镜面反射，也不是光源），有概率密度的材质可以用eval和pdf与光源采样组合
+template <typename Material>
+inline bool material_has_density(const Material& m)
+{
+    if constexpr (requires { m.specular(); })
+    {
+        return !m.specular();
+    }
+    else
+    {
+        return requires(const hit_record& rec, const vec3& w) { m.pdf(rec, w, w); };
+    }
+}
+
+/// @brief 场景中所有材质的连续存储，材质下标就是hit_record::material_id
+class material_table
+{
+public:
+    /// @brief 添加一个材质，返回材质下标
+    uint32_t add(const material& m)
+    {
+        _materials.push_back(m);
+        return static_cast<uint32_t>(_materials.size() - 1);
+    }
+
+    void reserve(size_t count)
+    {
+        _materials.reserve(count);
+    }
+
+    const material& operator[](uint32_t id) const noexcept
+    {
+        return _materials[id];
+    }
+
+    size_t size() const noexcept
+    {
+        return _materials.size();
+    }
+
+    material_kind kind(uint32_t id) const noexcept
+    {
+        return static_cast<material_kind>(_materials[id].index());
+    }
+
+    /// @brief 用rec.material_id对应的材质散射光线，std::visit按类型分发，scatter可以内联
+    bool scatter(const ray& r_in, const hit_record& rec, vec3& attenuation, ray& scattered) const
+    {
+        return std::visit([&](const auto& m) { return m.scatter(r_in, rec, attenuation, scattered); }, _materials[rec.material_id]);
+    }
+
+    /// @brief rec.material_id对应的材质发出的光，不发光的材质是0
+    vec3 emitted(const hit_record& rec) const
+    {
+        return std::visit([&](const auto& m) { return material_emitted(m, rec); }, _materials[rec.material_id]);
+    }
+
+    /// @brief 用rec.material_id对应的材质按BSDF采样散射方向，没有sample的材质（光源）返回false
+    /// @param xi [0, 1)上的3个均匀分布的随机数
+    bool sample(const ray& r_in, const hit_record& rec, const double xi[3], scatter_sample& out) const
+    {
+        return std::visit(
+            [&](const auto& m) {
+                if constexpr (requires { m.sample(r_in, rec, xi, out); })
+                {
+                    return m.sample(r_in, rec, xi, out);
+                }
+                else
+                {
+                    return false;
+                }
+            },
+            _materials[rec.material_id]);
+    }
+
+    /// @brief BSDF乘以cos(wi, 法线)，没有概率密度的材质是0，见scatter_sample
+    vec3 eval(const hit_record& rec, const vec3& wo, const vec3& wi) const
+    {
+        return std::visit(
+            [&](const auto& m) {
+                if constexpr (requires { m.eval(rec, wo, wi); })
+                {
+                    return m.eval(rec, wo, wi);
+                }
+                else
+                {
+                    return vec3(0, 0, 0);
+                }
+            },
+            _materials[rec.material_id]);
+    }
+
+    /// @brief sample生成wi的概率密度，没有概率密度的材质是0
+    real pdf(const hit_record& rec, const vec3& wo, const vec3& wi) const
+    {
+        return std::visit(
+            [&](const auto& m) {
+                if constexpr (requires { m.pdf(rec, wo, wi); })
+                {
+                    return m.pdf(rec, wo, wi);
+                }
+                else
+                {
+                    return real(0);
+                }
+            },
+            _materials[rec.material_id]);
+    }
+
+    /// @brief 见material_has_density
+    bool has_density(uint32_t id) const
+    {
+        return std::visit([](const auto& m) { return material_has_density(m); }, _materials[id]);
+    }
+
+    /// @brief 材质是否发光，发光材质的物体作为光源采样
+    bool emissive(uint32_t id) const noexcept
+    {
+        return kind(id) == material_kind::diffuse_light;
+    }
+
+private:
+    std::vector<material> _materials;
+};
+
+/// @brief 按材质的sample生成方向的分布，用于与其他分布混合，见mixture_pdf
+class material_pdf
+{
+public:
+    material_pdf(const material_table& materials, const ray& r_in, const hit_record& rec) noexcept
+        : _materials(materials)
+        , _r_in(r_in)
+        , _rec(rec)
+        , _wo(-unit_vector(r_in.direction()))
+    {
+    }
+
+    bool generate(const double xi[3], vec3& direction) const
+    {
+        scatter_sample s;
+        if (!_materials.sample(_r_in, _rec, xi, s))
+        {
+            return false;
+        }
+        direction = s.direction;
+        return true;
+    }
+
+    real value(const vec3& direction) const
+    {
+        return _materials.pdf(_rec, _wo, direction);
+    }
+
+private:
+    const material_table& _materials;
+    const ray& _r_in;
+    const hit_record& _rec;
+    vec3 _wo;
 };
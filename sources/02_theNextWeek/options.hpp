@@ -0,0 +1,343 @@
+#pragma once
+
+#include "camera.hpp"
+#include "framebuffer.hpp"
+#include "integrator.hpp"
+#include "renderer.hpp"
+#include "rtweekend.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <iterator>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <string_view>
+
+/// @brief 命令行参数，默认值就是不带参数时的渲染设置
+struct render_options
+{
+    render_settings settings;                                   // 分辨率、每像素样本数、线程数、种子
+    int max_depth { 50 };                                       // 反射的最大次数
+    int roulette_depth { 3 };                                   // iterative积分器在这么多次弹射之后使用俄罗斯轮盘赌
+    std::string output { "image.ppm" };                         // 输出文件
+    std::optional<image_format> format;                         // 为空时由输出文件的扩展名决定：.ppm、.pfm或.png
+    std::string scene { "the_next_week" };                      // 场景名（见make_scene）或场景文件（见load_scene）
+    std::string save_scene;                                     // 非空时把场景写入这个文件后退出，格式见is_binary_scene_path
+    std::string bvh_cache;                                      // 非空时在这个目录中缓存BVH，见scene::build_cached
+    integrator_mode integrator { integrator_mode::recursive };
+    bool adaptive { false };                                    // 渐进式自适应采样（只用于recursive和iterative）
+    progressive_settings progressive { .preview_interval = 8 }; // 自适应采样的收敛阈值和中间结果的输出间隔
+    bool help { false };
+
+    // 相机参数，为空时使用场景的默认值
+    std::optional<vec3> lookfrom;
+    std::optional<vec3> lookat;
+    std::optional<real> vfov;
+    std::optional<real> aperture;
+    std::optional<real> focus_dist;
+};
+
+inline void print_usage(std::ostream& out, std::string_view program)
+{
+    out << "Usage: " << program << " [options]\n"
+        << "       " << program << " compare <image a> <image b>\n"
+        << "\n"
+        << "Options (--name value or --name=value):\n"
+        << "  --width <n>             image width (200)\n"
+        << "  --height <n>            image height (100)\n"
+        << "  --spp <n>               samples per pixel (100)\n"
+        << "  --depth <n>             maximum bounces (50)\n"
+        << "  --threads <n>           worker threads, 0 = hardware threads (0)\n"
+        << "  --tile <n>              tile size in pixels (16)\n"
+        << "  --seed <n>              random seed for scene and image (0)\n"
+        << "  --output <path>         output file (image.ppm)\n"
+        << "  --format <ppm|pfm|png>  output format, default from the extension\n"
+        << "  --scene <name|file>     in_one_weekend, the_next_week, cornell_box, spheres_<n>[k|m] or a scene file (the_next_week)\n"
+        << "  --save-scene <file>     write the scene (text, or binary for .bin) and exit\n"
+        << "  --bvh-cache <dir>       reuse BVHs cached in this directory, keyed by a hash of the scene\n"
+        << "  --integrator <name>     recursive, iterative (samples lights), wavefront or packet (recursive)\n"
+        << "  --rr-depth <n>          bounces before Russian roulette, iterative only (3)\n"
+        << "  --adaptive              progressive adaptive sampling, recursive or iterative only\n"
+        << "  --error-threshold <e>   stop sampling a pixel below this standard error, adaptive only (0.01)\n"
+        << "  --preview-interval <n>  overwrite the output every n passes, 0 = never, adaptive only (8)\n"
+        << "  --sampler <name>        random or sobol (Owen-scrambled), recursive or iterative only (random)\n"
+        << "  --lookfrom <x,y,z>      camera position\n"
+        << "  --lookat <x,y,z>        camera target\n"
+        << "  --vfov <degrees>        vertical field of view, between 0 and 180\n"
+        << "  --aperture <a>          lens aperture\n"
+        << "  --focus-dist <d>        focus distance, greater than 0\n"
+        << "  --help                  show this message\n";
+}
+
+/// @brief 把整个字符串解析为一个数，有多余的字符时失败
+template <typename T>
+bool parse_number(std::string_view text, T& value) noexcept
+{
+    const auto last   = text.data() + text.size();
+    const auto result = std::from_chars(text.data(), last, value);
+    return !text.empty() && result.ec == std::errc() && result.ptr == last;
+}
+
+/// @brief 解析逗号分隔的三个数，例如13,2,3
+inline bool parse_vec3(std::string_view text, vec3& value) noexcept
+{
+    double e[3];
+    for (int a = 0; a < 3; ++a)
+    {
+        const auto comma = a < 2 ? text.find(',') : text.size();
+        if (comma == std::string_view::npos || !parse_number(text.substr(0, comma), e[a]))
+        {
+            return false;
+        }
+        text.remove_prefix(a < 2 ? comma + 1 : comma);
+    }
+    value = vec3(e[0], e[1], e[2]);
+    return true;
+}
+
+inline bool parse_image_format(std::string_view text, image_format& format) noexcept
+{
+    if (text == "ppm")
+    {
+        format = image_format::ppm;
+    }
+    else if (text == "pfm")
+    {
+        format = image_format::pfm;
+    }
+    else if (text == "png")
+    {
+        format = image_format::png;
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
+
+/// @brief 解析命令行参数
+/// 为了兼容以前的用法，单独的wavefront和adaptive分别等同于--integrator wavefront和--adaptive
+/// @param error 失败时写入错误信息
+/// @return 是否成功
+inline bool parse_options(int argc, char* argv[], render_options& options, std::string& error)
+{
+    // 需要一个值的选项
+    constexpr std::string_view value_options[] = { "--width", "--height", "--spp", "--depth", "--threads", "--tile", "--seed", "--output", "--format",
+        "--scene", "--save-scene", "--bvh-cache", "--integrator", "--rr-depth", "--sampler", "--error-threshold", "--preview-interval",
+        "--lookfrom", "--lookat", "--vfov", "--aperture", "--focus-dist" };
+
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string_view arg(argv[i]);
+
+        if (arg == "wavefront")
+        {
+            options.integrator = integrator_mode::wavefront;
+            continue;
+        }
+        if (arg == "adaptive" || arg == "--adaptive")
+        {
+            options.adaptive = true;
+            continue;
+        }
+        if (arg == "--help" || arg == "-h")
+        {
+            options.help = true;
+            continue;
+        }
+        if (!arg.starts_with("--"))
+        {
+            error = "unexpected argument: " + std::string(arg);
+            return false;
+        }
+
+        // 值可以写在=之后，也可以是下一个参数
+        std::string_view name = arg;
+        std::string_view value;
+        const auto eq = arg.find('=');
+        if (eq != std::string_view::npos)
+        {
+            name  = arg.substr(0, eq);
+            value = arg.substr(eq + 1);
+        }
+        if (std::find(std::begin(value_options), std::end(value_options), name) == std::end(value_options))
+        {
+            error = "unknown option: " + std::string(name);
+            return false;
+        }
+        if (eq == std::string_view::npos)
+        {
+            if (i + 1 >= argc)
+            {
+                error = "missing value for " + std::string(name);
+                return false;
+            }
+            value = argv[++i];
+        }
+
+        bool valid = true;
+        double number;
+        vec3 v;
+        image_format format;
+        auto& s = options.settings;
+        if (name == "--width")
+        {
+            valid = parse_number(value, s.image_width) && s.image_width > 0;
+        }
+        else if (name == "--height")
+        {
+            valid = parse_number(value, s.image_height) && s.image_height > 0;
+        }
+        else if (name == "--spp")
+        {
+            valid = parse_number(value, s.samples_per_pixel) && s.samples_per_pixel > 0;
+        }
+        else if (name == "--depth")
+        {
+            valid = parse_number(value, options.max_depth) && options.max_depth > 0;
+        }
+        else if (name == "--threads")
+        {
+            valid = parse_number(value, s.thread_count);
+        }
+        else if (name == "--tile")
+        {
+            valid = parse_number(value, s.tile_size) && s.tile_size > 0;
+        }
+        else if (name == "--seed")
+        {
+            valid = parse_number(value, s.seed);
+        }
+        else if (name == "--output")
+        {
+            options.output = value;
+            valid          = !value.empty();
+        }
+        else if (name == "--format")
+        {
+            valid = parse_image_format(value, format);
+            if (valid)
+            {
+                options.format = format;
+            }
+        }
+        else if (name == "--scene")
+        {
+            options.scene = value;
+        }
+        else if (name == "--save-scene")
+        {
+            options.save_scene = value;
+            valid              = !value.empty();
+        }
+        else if (name == "--bvh-cache")
+        {
+            options.bvh_cache = value;
+            valid             = !value.empty();
+        }
+        else if (name == "--integrator")
+        {
+            if (value == "recursive")
+            {
+                options.integrator = integrator_mode::recursive;
+            }
+            else if (value == "wavefront")
+            {
+                options.integrator = integrator_mode::wavefront;
+            }
+            else if (value == "packet")
+            {
+                options.integrator = integrator_mode::packet;
+            }
+            else if (value == "iterative")
+            {
+                options.integrator = integrator_mode::iterative;
+            }
+            else
+            {
+                valid = false;
+            }
+        }
+        else if (name == "--sampler")
+        {
+            if (value == "random")
+            {
+                options.settings.sampler = sampler_kind::independent;
+            }
+            else if (value == "sobol")
+            {
+                options.settings.sampler = sampler_kind::sobol;
+            }
+            else
+            {
+                valid = false;
+            }
+        }
+        else if (name == "--error-threshold")
+        {
+            valid = parse_number(value, options.progressive.error_threshold) && options.progressive.error_threshold > 0;
+        }
+        else if (name == "--preview-interval")
+        {
+            valid = parse_number(value, options.progressive.preview_interval) && options.progressive.preview_interval >= 0;
+        }
+        else if (name == "--rr-depth")
+        {
+            valid = parse_number(value, options.roulette_depth) && options.roulette_depth >= 0;
+        }
+        else if (name == "--lookfrom" || name == "--lookat")
+        {
+            valid = parse_vec3(value, v);
+            if (valid)
+            {
+                (name == "--lookfrom" ? options.lookfrom : options.lookat) = v;
+            }
+        }
+        else if (name == "--vfov")
+        {
+            valid = parse_number(value, number) && valid_vfov(number);
+            if (valid)
+            {
+                options.vfov = static_cast<real>(number);
+            }
+        }
+        else if (name == "--aperture")
+        {
+            valid = parse_number(value, number) && valid_aperture(number);
+            if (valid)
+            {
+                options.aperture = static_cast<real>(number);
+            }
+        }
+        else if (name == "--focus-dist")
+        {
+            valid = parse_number(value, number) && valid_focus_dist(number);
+            if (valid)
+            {
+                options.focus_dist = static_cast<real>(number);
+            }
+        }
+
+        if (!valid)
+        {
+            error = "invalid value for " + std::string(name) + ": " + std::string(value);
+            return false;
+        }
+    }
+
+    if (options.adaptive && options.integrator != integrator_mode::recursive && options.integrator != integrator_mode::iterative)
+    {
+        error = "--adaptive is only supported by the recursive and iterative integrators";
+        return false;
+    }
+    // wavefront和packet自己生成主光线，不使用采样器
+    if (options.settings.sampler != sampler_kind::independent && options.integrator != integrator_mode::recursive
+        && options.integrator != integrator_mode::iterative)
+    {
+        error = "--sampler is only supported by the recursive and iterative integrators";
+        return false;
+    }
+    return true;
+}
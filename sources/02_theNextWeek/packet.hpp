@@ -0,0 +1,91 @@
+#pragma once
+
+#include "camera.hpp"
+#include "hittable.hpp"
+#include "integrator.hpp"
+#include "material.hpp"
+#include "renderer.hpp"
+#include "sphere_soa.hpp"
+#include "stats.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdint>
+
+/// @brief 主光线按块求交的路径追踪：每个分块切成ray_block::width x ray_block::width的像素块，
+/// 每个样本用camera::get_ray_block一次生成整块的主光线，用sphere_soa::hit_block一起遍历BVH，
+/// 之后每条路径的弹射与ray_color相同，期望与render_tiles相同
+/// 每块每个样本用(seed, 块的第一个像素, 样本序号)设置随机数种子，每条路径再用光线在块中的序号重新设置，结果与线程数无关
+/// @param primary 主光线求交的球
+/// @param surfaces 主光线求交的其他物体（四边形等），primary和surfaces中的物体必须与world中的相同
+/// @param world 弹射之后的光线求交的场景
+/// @param lights 场景中的光源，见ray_color
+/// @return 帧缓冲，格式与render_tiles相同
+inline framebuffer render_packets(const render_settings& settings, const camera& cam, const sphere_soa& primary, const hittable& surfaces,
+                                  const hittable& world, const material_table& materials, const light_list& lights, int max_depth)
+{
+    const int width  = settings.image_width;
+    const int height = settings.image_height;
+    const int spp    = settings.samples_per_pixel;
+
+    framebuffer image(width, height);
+
+    for_each_tile(settings, [&](const tile& t) {
+        auto& generator = thread_rng();
+        ray_block block;
+        std::array<hit_record, ray_block::size> hits;
+        std::array<vec3, ray_block::size> color;
+
+        for (int by = t.y0; by < t.y1; by += ray_block::width)
+        {
+            for (int bx = t.x0; bx < t.x1; bx += ray_block::width)
+            {
+                const int columns = std::min(ray_block::width, t.x1 - bx);
+                const int rows    = std::min(ray_block::width, t.y1 - by);
+                // 块的第r行（从下往上）是图像的第by + rows - 1 - r行
+                const int j0           = height - by - rows;
+                const auto first_index = static_cast<uint64_t>(by) * width + bx;
+
+                color.fill(vec3(0, 0, 0));
+                const auto cost = stats::thread_cost();
+                for (int s = 0; s < spp; ++s)
+                {
+                    const uint64_t seed = hash_seed(hash_seed(settings.seed, first_index), static_cast<uint64_t>(s));
+                    generator.seed(seed);
+                    cam.get_ray_block(bx, j0, columns, rows, width, height, s, spp, generator, block);
+
+                    const uint64_t hit = primary.hit_block(block, 0.001, infinity, hits.data());
+                    for (uint64_t mask = block.active; mask != 0; mask &= mask - 1)
+                    {
+                        const int k           = std::countr_zero(mask);
+                        const ray r           = block.get(k);
+                        const bool sphere_hit = (hit >> k) & 1;
+                        // 其他物体只需要检查比球更近的交点
+                        const bool hit_k = surfaces.hit(r, 0.001, sphere_hit ? hits[k].t : infinity, hits[k]) || sphere_hit;
+
+                        const stats::bounce_scope scope;
+                        stats::count_ray(scope.bounce(), hit_k);
+
+                        generator.seed(hash_seed(seed, static_cast<uint64_t>(k) + 1));
+                        color[k] += shade(r, hit_k, hits[k], world, materials, lights, max_depth);
+                    }
+                }
+
+                // 整块的遍历代价平均分给块中的像素
+                const auto pixel_cost = (stats::thread_cost() - cost) / static_cast<uint64_t>(columns * rows);
+                for (int r = 0; r < rows; ++r)
+                {
+                    const int y = by + rows - 1 - r;
+                    for (int c = 0; c < columns; ++c)
+                    {
+                        image.add(bx + c, y, color[r * ray_block::width + c], static_cast<uint32_t>(spp));
+                        stats::add_pixel_cost(static_cast<size_t>(y) * width + bx + c, pixel_cost);
+                    }
+                }
+            }
+        }
+    });
+
+    return image;
+}
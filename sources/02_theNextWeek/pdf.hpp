@@ -0,0 +1,146 @@
+#pragma once
+
+#include "rtweekend.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+// 方向的概率密度（立体角上），用于重要性采样，每种pdf都有两个函数：
+//     bool generate(const double xi[3], vec3& direction) const  按这个分布用[0, 1)上的均匀随机数生成一个单位向量，失败时返回false
+//     real value(const vec3& direction) const                   单位向量direction的概率密度，是generate成功生成的方向的密度
+// 生成失败的样本贡献为0，这样估计仍然是无偏的。pdf按值组合（mixture_pdf），不需要虚函数
+
+/// @brief 以normal为中心的余弦分布，p = cos / pi，Lambert漫反射的BRDF乘以余弦正比于这个分布
+class cosine_pdf
+{
+public:
+    explicit cosine_pdf(const vec3& normal) noexcept
+        : _normal(normal)
+    {
+        orthonormal_basis(normal, _b1, _b2);
+    }
+
+    /// @brief 使用xi[0]和xi[1]，单位圆盘上的均匀分布投影到半球上（Malley方法）
+    bool generate(const double xi[3], vec3& direction) const
+    {
+        const real r   = std::sqrt(static_cast<real>(xi[0]));
+        const real phi = 2 * pi * xi[1];
+        const real z   = std::sqrt(std::max(real(0), 1 - static_cast<real>(xi[0])));
+        direction      = r * std::cos(phi) * _b1 + r * std::sin(phi) * _b2 + z * _normal;
+        return true;
+    }
+
+    real value(const vec3& direction) const
+    {
+        return std::max(real(0), dot(direction, _normal)) / pi;
+    }
+
+private:
+    vec3 _normal;
+    vec3 _b1, _b2;
+};
+
+/// @brief GGX（Trowbridge-Reitz）法线分布，D(h) = a^2 / (pi * ((n.h)^2 * (a^2 - 1) + 1)^2)
+inline real ggx_distribution(real cos_h, real alpha)
+{
+    const real a2 = alpha * alpha;
+    const real d  = cos_h * cos_h * (a2 - 1) + 1;
+    return a2 / (pi * d * d);
+}
+
+/// @brief GGX的Smith遮挡函数G1，cos是方向与宏观法线的夹角余弦
+inline real ggx_smith_g1(real cos, real alpha)
+{
+    const real a2 = alpha * alpha;
+    return 2 * cos / (cos + std::sqrt(a2 + (1 - a2) * cos * cos));
+}
+
+/// @brief 光泽反射的波瓣：按D(h) * cos(h)采样微表面法线h，出射方向是wo关于h的反射方向，
+/// 方向的概率密度是D(h) * cos(h) / (4 * dot(wo, h))
+class ggx_pdf
+{
+public:
+    /// @param wo 指向观察者的单位向量
+    /// @param alpha 粗糙度，越小波瓣越窄
+    ggx_pdf(const vec3& normal, const vec3& wo, real alpha) noexcept
+        : _normal(normal)
+        , _wo(wo)
+        , _alpha(alpha)
+    {
+        orthonormal_basis(normal, _b1, _b2);
+    }
+
+    /// @brief 使用xi[0]和xi[1]，反射方向在表面以下时返回false
+    bool generate(const double xi[3], vec3& direction) const
+    {
+        const real a2    = _alpha * _alpha;
+        const real u     = static_cast<real>(xi[0]);
+        const real cos2  = (1 - u) / (1 + (a2 - 1) * u);
+        const real cos_h = std::sqrt(cos2);
+        const real sin_h = std::sqrt(std::max(real(0), 1 - cos2));
+        const real phi   = 2 * pi * xi[1];
+        const vec3 h     = sin_h * std::cos(phi) * _b1 + sin_h * std::sin(phi) * _b2 + cos_h * _normal;
+
+        direction = 2 * dot(_wo, h) * h - _wo;
+        return dot(direction, _normal) > 0;
+    }
+
+    real value(const vec3& direction) const
+    {
+        const vec3 half    = _wo + direction;
+        const real length2 = half.length_squared();
+        if (length2 <= 0 || dot(direction, _normal) <= 0)
+        {
+            return 0;
+        }
+        const vec3 h        = half / std::sqrt(length2);
+        const real cos_h    = dot(h, _normal);
+        const real wo_dot_h = dot(_wo, h);
+        if (cos_h <= 0 || wo_dot_h <= 0)
+        {
+            return 0;
+        }
+        return ggx_distribution(cos_h, _alpha) * cos_h / (4 * wo_dot_h);
+    }
+
+private:
+    vec3 _normal;
+    vec3 _wo;
+    real _alpha;
+    vec3 _b1, _b2;
+};
+
+/// @brief 两个分布的混合，以weight的概率按A生成，否则按B生成，概率密度是两者的加权和（单样本的多重重要性采样）
+template <typename A, typename B>
+class mixture_pdf
+{
+public:
+    mixture_pdf(const A& a, const B& b, real weight) noexcept
+        : _a(a)
+        , _b(b)
+        , _weight(weight)
+    {
+    }
+
+    /// @brief xi[0]选择分布，再缩放回[0, 1)传给选中的分布，两个分布都可以使用三个数
+    bool generate(const double xi[3], vec3& direction) const
+    {
+        if (xi[0] < _weight)
+        {
+            const double remapped[3] = { xi[0] / _weight, xi[1], xi[2] };
+            return _a.generate(remapped, direction);
+        }
+        const double remapped[3] = { (xi[0] - _weight) / (1 - _weight), xi[1], xi[2] };
+        return _b.generate(remapped, direction);
+    }
+
+    real value(const vec3& direction) const
+    {
+        return _weight * _a.value(direction) + (1 - _weight) * _b.value(direction);
+    }
+
+private:
+    A _a;
+    B _b;
+    real _weight;
+};
@@ -0,0 +1,104 @@
+#pragma once
+
+#include "hittable.hpp"
+#include "rtweekend.hpp"
+
+#include <cmath>
+
+/// @brief 平行四边形，顶点是Q，两条边是u和v，点Q + a * u + b * v（0 <= a, b <= 1）在四边形上
+/// 法线是cross(u, v)的方向，发光材质只向法线一侧发光，见diffuse_light
+class quad : public hittable
+{
+public:
+    quad(const vec3& q, const vec3& edge_u, const vec3& edge_v, uint32_t m)
+        : Q(q)
+        , u(edge_u)
+        , v(edge_v)
+        , material_id(m)
+    {
+        const vec3 n = cross(u, v);
+        normal       = unit_vector(n);
+        D            = dot(normal, Q);
+        w            = n / dot(n, n);
+        area         = n.length();
+    }
+
+    virtual bool hit(const ray& r, real t_min, real t_max, hit_record& rec) const override
+    {
+        stats::count_primitive_tests(1);
+
+        real t;
+        if (!intersect(r, t_min, t_max, t))
+        {
+            return false;
+        }
+
+        rec.t = t;
+        rec.p = r.at(t);
+        rec.set_face_normal(r, normal);
+        rec.material_id = material_id;
+        return true;
+    }
+
+    virtual bool occluded(const ray& r, real t_min, real t_max) const override
+    {
+        stats::count_primitive_tests(1);
+
+        real t;
+        return intersect(r, t_min, t_max, t);
+    }
+
+    virtual bool bounding_box(real t0, real t1, aabb& output_box) const override
+    {
+        // 与坐标轴对齐的四边形在一个轴上没有厚度，稍微扩大包围盒，避免包围盒求交时除以0得到NaN
+        const vec3 corners[3] = { Q + u, Q + v, Q + u + v };
+        vec3 small            = Q;
+        vec3 big              = Q;
+        for (const auto& c : corners)
+        {
+            small = vec3(ffmin(small.x(), c.x()), ffmin(small.y(), c.y()), ffmin(small.z(), c.z()));
+            big   = vec3(ffmax(big.x(), c.x()), ffmax(big.y(), c.y()), ffmax(big.z(), c.z()));
+        }
+        const vec3 padding(real(1e-4), real(1e-4), real(1e-4));
+        output_box = aabb(small - padding, big + padding);
+        return true;
+    }
+
+    /// @brief 参数(a, b)对应的四边形上的点，a和b是[0, 1)上的均匀分布时这个点在四边形上均匀分布
+    vec3 point(real a, real b) const noexcept
+    {
+        return Q + a * u + b * v;
+    }
+
+private:
+    /// @brief 先求与平面的交点，再用交点在u、v上的坐标判断是否在四边形内
+    bool intersect(const ray& r, real t_min, real t_max, real& t) const noexcept
+    {
+        const auto denom = dot(normal, r.direction());
+        if (std::fabs(denom) < real(1e-8))
+        {
+            return false; // 光线与平面平行
+        }
+
+        t = (D - dot(normal, r.origin())) / denom;
+        if (!(t > t_min && t < t_max))
+        {
+            return false;
+        }
+
+        const vec3 planar = r.at(t) - Q;
+        const auto alpha  = dot(w, cross(planar, v));
+        const auto beta   = dot(w, cross(u, planar));
+        return alpha >= 0 && alpha <= 1 && beta >= 0 && beta <= 1;
+    }
+
+public:
+    vec3 Q;
+    vec3 u;
+    vec3 v;
+    uint32_t material_id { 0 };
+    vec3 normal; // 单位法线
+    real D;      // 平面方程dot(normal, p) = D
+    vec3 w;      // cross(u, v) / |cross(u, v)|^2，用于计算交点在u、v上的坐标
+    real area;
+};
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+/// @brief 将两个64位整数混合为一个随机种子（splitmix64）
+/// @param a
+/// @param b
+/// @return
+inline uint64_t hash_seed(uint64_t a, uint64_t b = 0) noexcept
+{
+    uint64_t z = a + 0x9e3779b97f4a7c15ull * (b + 1);
+    z          = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z          = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+/// @brief xoshiro256+ 随机数生成器
+/// 状态只有32字节，生成一个数只需要几次移位和加法，不需要构造std::uniform_real_distribution
+/// 可以按像素、按样本设置种子，每个线程持有一个（见thread_rng）或者显式传递
+class rng
+{
+public:
+    constexpr rng() noexcept = default;
+
+    explicit rng(uint64_t seed) noexcept
+    {
+        this->seed(seed);
+    }
+
+    /// @brief 用splitmix64把种子展开为256位状态
+    void seed(uint64_t seed) noexcept
+    {
+        for (auto& s : _s)
+        {
+            seed += 0x9e3779b97f4a7c15ull;
+            s = hash_seed(seed);
+        }
+    }
+
+    uint64_t next_u64() noexcept
+    {
+        const uint64_t result = _s[0] + _s[3];
+        const uint64_t t      = _s[1] << 17;
+
+        _s[2] ^= _s[0];
+        _s[3] ^= _s[1];
+        _s[1] ^= _s[2];
+        _s[0] ^= _s[3];
+        _s[2] ^= t;
+        _s[3] = rotl(_s[3], 45);
+
+        return result;
+    }
+
+    /// @brief [0, 1)上的均匀分布，取高53位作为尾数
+    double uniform() noexcept
+    {
+        return static_cast<double>(next_u64() >> 11) * 0x1.0p-53;
+    }
+
+    /// @brief [min, max)上的均匀分布
+    double uniform(double min, double max) noexcept
+    {
+        return min + (max - min) * uniform();
+    }
+
+    /// @brief [min, max]上的均匀整数
+    int uniform_int(int min, int max) noexcept
+    {
+        const auto range = static_cast<uint64_t>(static_cast<int64_t>(max) - min + 1);
+        // 高32位乘以区间长度再取高位（Lemire），区间很小时偏差可以忽略
+        return min + static_cast<int>(((next_u64() >> 32) * range) >> 32);
+    }
+
+    /// @brief 批量生成[0, 1)上的均匀分布，一次填满整块内存
+    void fill(std::span<double> out) noexcept
+    {
+        for (auto& x : out)
+        {
+            x = uniform();
+        }
+    }
+
+private:
+    static constexpr uint64_t rotl(uint64_t x, int k) noexcept
+    {
+        return (x << k) | (x >> (64 - k));
+    }
+
+private:
+    uint64_t _s[4] { 0x9e3779b97f4a7c15ull, 0xbf58476d1ce4e5b9ull, 0x94d049bb133111ebull, 0x2545f4914f6cdd1dull };
+};
+
+/// @brief 当前线程的随机数生成器，多线程渲染时互不干扰
+inline rng& thread_rng() noexcept
+{
+    thread_local rng generator;
+    return generator;
+}
+
+/// @brief 重新设置当前线程随机数生成器的种子，用于固定种子复现渲染结果
+/// @param seed
+inline void seed_random(uint64_t seed) noexcept
+{
+    thread_rng().seed(seed);
+}
+
+/// @brief 像素内的分层抖动：前n * n个样本（n = floor(sqrt(count))）各落在像素的一个n x n格子中，其余样本在整个像素内均匀分布
+/// @param sample 样本序号
+/// @param count 像素的样本总数
+/// @param xi 两个[0, 1)上的均匀随机数
+/// @param out 像素内的坐标，[0, 1) x [0, 1)
+inline void stratified_jitter(int sample, int count, const double xi[2], double out[2]) noexcept
+{
+    int n = 1;
+    while ((n + 1) * (n + 1) <= count)
+    {
+        ++n;
+    }
+
+    if (sample >= n * n)
+    {
+        out[0] = xi[0];
+        out[1] = xi[1];
+        return;
+    }
+    out[0] = (sample % n + xi[0]) / n;
+    out[1] = (sample / n + xi[1]) / n;
+}
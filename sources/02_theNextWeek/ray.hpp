@@ -2,40 +2,78 @@
 
 #include "vec3.hpp"
 
-class ray
+#include <cstdint>
+
+/// @brief 光线，模板参数是标量类型，渲染使用ray = basic_ray<real>
+template <typename T>
+class basic_ray
 {
 public:
-    constexpr ray() noexcept = default;
+    using vector_type = basic_vec3<T>;
+
+    constexpr basic_ray() noexcept = default;
 
-    ray(const vec3& origin, const vec3& direction, double time = 0.0)
+    basic_ray(const vector_type& origin, const vector_type& direction, T time = 0)
         : orig(origin)
         , dir(direction)
         , tm(time)
     {
     }
 
-    vec3 origin() const
+    vector_type origin() const
     {
         return orig;
     }
 
-    vec3 direction() const
+    vector_type direction() const
     {
         return dir;
     }
 
-    double time() const
+    T time() const
     {
         return tm;
     }
 
-    vec3 at(double t) const
+    vector_type at(T t) const
     {
         return orig + t * dir;
     }
 
 private:
-    vec3 orig;
-    vec3 dir;
-    double tm { 0.0 };
-};
\ No newline at end of file
+    vector_type orig;
+    vector_type dir;
+    T tm { 0 };
+};
+
+using ray = basic_ray<real>;
+
+/// @brief 一块ray_block::width x ray_block::width个像素的主光线，按结构数组（SoA）存储
+/// 第k条光线对应块中第k / width行（从下往上）、第k % width列的像素，active中没有置位的通道不参与求交
+struct alignas(32) ray_block
+{
+    static constexpr int width = 8;
+    static constexpr int size  = width * width;
+
+    real origin[3][size];
+    real direction[3][size];
+    real time[size];
+    uint64_t active { 0 };
+
+    ray get(int k) const noexcept
+    {
+        return ray(vec3(origin[0][k], origin[1][k], origin[2][k]), vec3(direction[0][k], direction[1][k], direction[2][k]), time[k]);
+    }
+
+    void set(int k, const ray& r) noexcept
+    {
+        const vec3 o = r.origin();
+        const vec3 d = r.direction();
+        for (int a = 0; a < 3; ++a)
+        {
+            origin[a][k]    = o[a];
+            direction[a][k] = d[a];
+        }
+        time[k] = r.time();
+    }
+};
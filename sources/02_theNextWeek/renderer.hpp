@@ -0,0 +1,274 @@
+#pragma once
+
+#include "framebuffer.hpp"
+#include "rtweekend.hpp"
+#include "sampler.hpp"
+#include "stats.hpp"
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+/// @brief 渲染参数
+struct render_settings
+{
+    int image_width { 200 };
+    int image_height { 100 };
+    int samples_per_pixel { 100 };
+    int tile_size { 16 };                               // 分块的边长（像素）
+    size_t thread_count { 0 };                          // 为0时使用硬件线程数
+    uint64_t seed { 0 };                                // 固定种子时渲染结果与线程数无关
+    sampler_kind sampler { sampler_kind::independent }; // 像素、镜头、时间和弹射使用的随机数，见sampler
+};
+
+/// @brief 渐进式自适应采样的参数，总样本预算为render_settings::samples_per_pixel乘以像素数
+struct progressive_settings
+{
+    int min_samples { 16 };          // 第一轮每个像素的样本数
+    int max_samples { 1024 };        // 每个像素最多的样本数
+    int samples_per_pass { 8 };      // 之后每一轮给未收敛的像素增加的样本数
+    double error_threshold { 0.01 }; // 输出空间的标准误差低于这个值的像素停止采样，见framebuffer::display_error
+    int preview_interval { 0 };      // 每隔多少轮输出一次中间图像，为0时不输出
+};
+
+/// @brief 图像中的一个矩形分块，[x0, x1) x [y0, y1)
+struct tile
+{
+    int x0, y0, x1, y1;
+};
+
+/// @brief 把图像切分成tile_size x tile_size的分块，按从上到下、从左到右的顺序排列
+inline std::vector<tile> make_tiles(int width, int height, int tile_size)
+{
+    std::vector<tile> tiles;
+    for (int y = 0; y < height; y += tile_size)
+    {
+        for (int x = 0; x < width; x += tile_size)
+        {
+            tiles.push_back({ x, y, std::min(x + tile_size, width), std::min(y + tile_size, height) });
+        }
+    }
+    return tiles;
+}
+
+/// @brief 把图像切分成分块，每个分块作为一个任务交给线程池，阻塞直到所有分块完成
+/// 每个分块结束后把工作线程的统计合并到整帧，见stats
+/// @param settings
+/// @param render_tile 渲染一个分块，签名为void(const tile&)，只能写自己分块内的像素
+template <typename TileRenderer>
+void for_each_tile(const render_settings& settings, const TileRenderer& render_tile)
+{
+    auto tiles = make_tiles(settings.image_width, settings.image_height, settings.tile_size);
+
+    std::atomic<size_t> tiles_remaining { tiles.size() };
+
+    thread_pool pool(settings.thread_count);
+
+    for (const auto& t : tiles)
+    {
+        // 每个任务只写自己分块内的像素，不需要加锁
+        pool.submit([&, t] {
+            render_tile(t);
+            stats::flush_thread();
+            tiles_remaining.fetch_sub(1, std::memory_order_relaxed);
+        });
+    }
+
+    while (!pool.wait_for(std::chrono::milliseconds(200)))
+    {
+        std::cerr << "\rTiles remaining: " << tiles_remaining.load(std::memory_order_relaxed) << ' ' << std::flush;
+    }
+    std::cerr << "\rTiles remaining: 0 " << std::flush;
+}
+
+/// @brief 多线程分块渲染
+/// 每个像素在渲染前用(seed, 像素序号)重新设置当前线程随机数生成器的种子，
+/// 所以同一个种子渲染出的图像与线程数、分块的调度顺序无关
+/// 像素内的位置取自采样器的sample_dimension::pixel维，之后的维度由sample使用
+/// @param settings
+/// @param sample 计算一个样本的颜色，参数为图像平面上的坐标(u, v)和已经开始这个样本的sampler&，必须是线程安全的
+/// @return 帧缓冲，每个像素累加了samples_per_pixel个样本
+template <typename Sample>
+framebuffer render_tiles(const render_settings& settings, const Sample& sample)
+{
+    const int width  = settings.image_width;
+    const int height = settings.image_height;
+
+    framebuffer image(width, height);
+
+    for_each_tile(settings, [&](const tile& t) {
+        sampler samples(settings.sampler, settings.seed);
+        for (int y = t.y0; y < t.y1; ++y)
+        {
+            // 图像第y行对应相机的第j条扫描线（j从下往上）
+            const int j = height - 1 - y;
+            for (int i = t.x0; i < t.x1; ++i)
+            {
+                const auto index = static_cast<size_t>(y) * width + i;
+                auto& generator  = thread_rng();
+                generator.seed(hash_seed(settings.seed, index));
+
+                const auto cost = stats::thread_cost();
+                vec3 color(0, 0, 0);
+                for (int s = 0; s < settings.samples_per_pixel; ++s)
+                {
+                    samples.start(index, static_cast<uint32_t>(s));
+                    double jitter[2];
+                    samples.get(sample_dimension::pixel, jitter);
+                    auto u = (i + jitter[0]) / width;
+                    auto v = (j + jitter[1]) / height;
+                    color += sample(u, v, samples);
+                }
+                image.add(i, y, color, static_cast<uint32_t>(settings.samples_per_pixel));
+                stats::add_pixel_cost(index, stats::thread_cost() - cost);
+            }
+        }
+    });
+
+    return image;
+}
+
+/// @brief 把一轮的样本计划限制在剩余的预算之内：超出时每个像素最多取同样的cap个样本（cap尽量大），
+/// 剩下的零头按像素序号每个多给一个，结果只取决于计划本身，与线程数无关
+/// @param wanted plan的总和
+/// @return 限制之后的样本总数
+inline uint64_t limit_plan(std::vector<int>& plan, uint64_t wanted, uint64_t remaining)
+{
+    if (wanted <= remaining)
+    {
+        return wanted;
+    }
+
+    const int most = *std::max_element(plan.begin(), plan.end());
+    const auto sum = [&](int cap) {
+        uint64_t total = 0;
+        for (const int n : plan)
+        {
+            total += static_cast<uint64_t>(std::min(n, cap));
+        }
+        return total;
+    };
+    int cap = most - 1;
+    while (cap > 0 && sum(cap) > remaining)
+    {
+        --cap;
+    }
+
+    uint64_t extra = remaining - sum(cap);
+    for (int& n : plan)
+    {
+        if (n > cap && extra > 0)
+        {
+            n = cap + 1;
+            --extra;
+        }
+        else
+        {
+            n = std::min(n, cap);
+        }
+    }
+    return remaining - extra;
+}
+
+/// @brief 渐进式自适应采样
+/// 第一轮每个像素采样min_samples次，之后每一轮只给误差仍高于error_threshold的像素增加样本，
+/// 直到所有像素收敛或者用完总样本预算，背景等简单像素很快停止采样，剩下的预算集中在噪声大的像素上
+/// 每一轮的样本总数不超过剩余的预算（见limit_plan），第一轮也是如此，所以总样本数不会超过预算
+/// 每一轮用(seed, 像素序号, 轮次)设置随机数种子，是否收敛只取决于像素自己的样本，结果与线程数无关
+/// 采样器的样本序号是像素已有的样本数，低差异序列跨轮次连续
+/// @param settings
+/// @param progressive
+/// @param sample 计算一个样本的颜色，与render_tiles相同
+/// @param preview 每隔preview_interval轮调用一次，签名为void(const framebuffer&, int pass)，在主线程中调用
+/// @return 帧缓冲，每个像素的样本数不同
+template <typename Sample, typename Preview>
+framebuffer render_progressive(const render_settings& settings, const progressive_settings& progressive, const Sample& sample, const Preview& preview)
+{
+    const int width  = settings.image_width;
+    const int height = settings.image_height;
+
+    framebuffer image(width, height);
+
+    const auto budget = static_cast<uint64_t>(settings.samples_per_pixel) * width * height;
+    uint64_t used     = 0;
+
+    // 每一轮开始前在主线程中确定每个像素的样本数，工作线程只按计划采样
+    std::vector<int> plan(static_cast<size_t>(width) * height);
+
+    int pass = 0;
+    for (;; ++pass)
+    {
+        const int pass_samples = pass == 0 ? progressive.min_samples : progressive.samples_per_pass;
+        uint64_t wanted        = 0;
+        for (int y = 0; y < height; ++y)
+        {
+            for (int i = 0; i < width; ++i)
+            {
+                int n = std::min(pass_samples, progressive.max_samples - static_cast<int>(image.samples(i, y)));
+                if (n <= 0 || (pass > 0 && image.display_error(i, y) <= progressive.error_threshold))
+                {
+                    n = 0;
+                }
+                plan[static_cast<size_t>(y) * width + i] = n;
+                wanted += static_cast<uint64_t>(n);
+            }
+        }
+        const uint64_t taken = limit_plan(plan, wanted, budget - used);
+        if (taken == 0)
+        {
+            break;
+        }
+
+        for_each_tile(settings, [&](const tile& t) {
+            sampler samples(settings.sampler, settings.seed);
+            for (int y = t.y0; y < t.y1; ++y)
+            {
+                const int j = height - 1 - y;
+                for (int i = t.x0; i < t.x1; ++i)
+                {
+                    const auto index = static_cast<size_t>(y) * width + i;
+                    const int n      = plan[index];
+                    if (n <= 0)
+                    {
+                        continue;
+                    }
+
+                    auto& generator = thread_rng();
+                    generator.seed(hash_seed(hash_seed(settings.seed, index), static_cast<uint64_t>(pass)));
+
+                    const auto cost  = stats::thread_cost();
+                    const auto first = image.samples(i, y);
+                    for (int s = 0; s < n; ++s)
+                    {
+                        samples.start(index, static_cast<uint32_t>(first + s));
+                        double jitter[2];
+                        samples.get(sample_dimension::pixel, jitter);
+                        auto u = (i + jitter[0]) / width;
+                        auto v = (j + jitter[1]) / height;
+                        image.add_sample(i, y, sample(u, v, samples));
+                    }
+                    stats::add_pixel_cost(index, stats::thread_cost() - cost);
+                }
+            }
+        });
+
+        used += taken;
+
+        if (progressive.preview_interval > 0 && (pass + 1) % progressive.preview_interval == 0)
+        {
+            preview(static_cast<const framebuffer&>(image), pass);
+        }
+
+        if (used >= budget)
+        {
+            break;
+        }
+    }
+
+    std::clog << "\nProgressive passes: " << pass + 1 << ", average samples per pixel: " << double(used) / (static_cast<double>(width) * height) << '\n';
+
+    return image;
+}
@@ -2,17 +2,26 @@
 
 #include <chrono>
 #include <cmath>
+#include <cstdint>
 #include <cstdlib>
 #include <functional>
 #include <limits>
 #include <memory>
 #include <numbers>
-#include <random>
+
+#include "random.hpp"
 
 // Usings
 using std::make_shared;
 using std::shared_ptr;
 
+// 渲染使用的浮点类型，定义了RT_USE_FLOAT时使用float（*_float目标），否则使用double
+#if defined(RT_USE_FLOAT)
+using real = float;
+#else
+using real = double;
+#endif
+
 // Constants
 const double infinity = std::numeric_limits<double>::infinity();
 const double pi       = std::numbers::pi_v<double>;
@@ -32,6 +41,11 @@ inline double ffmin(double a, double b)
     return a <= b ? a : b;
 }
 
+inline float ffmin(float a, float b)
+{
+    return a <= b ? a : b;
+}
+
 /// @brief 返回a和b的较大值
 /// @param a
 /// @param b
@@ -41,6 +55,11 @@ inline double ffmax(double a, double b)
     return a >= b ? a : b;
 }
 
+inline float ffmax(float a, float b)
+{
+    return a >= b ? a : b;
+}
+
 inline double clamp(double x, double min, double max)
 {
     if (x < min)
@@ -50,24 +69,19 @@ inline double clamp(double x, double min, double max)
     return x;
 }
 
-static std::default_random_engine randomEngine(static_cast<unsigned int>(std::chrono::system_clock::now().time_since_epoch().count()));
-
 inline double random_double()
 {
-    std::uniform_real_distribution<double> randomColor(0.0, 1.0);
-    return randomColor(randomEngine);
+    return thread_rng().uniform();
 }
 
 inline double random_double(double min, double max)
 {
-    std::uniform_real_distribution<double> randomColor(min, max);
-    return randomColor(randomEngine);
+    return thread_rng().uniform(min, max);
 }
 
 inline int random_int(int min, int max)
 {
-    std::uniform_int _random(min, max);
-    return _random(randomEngine);
+    return thread_rng().uniform_int(min, max);
 }
 
 #include "ray.hpp"
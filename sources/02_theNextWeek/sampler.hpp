@@ -0,0 +1,182 @@
+#pragma once
+
+#include "random.hpp"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+/// @brief 采样器的种类
+enum class sampler_kind
+{
+    independent, // 独立的伪随机数（xoshiro），收敛速度O(1/sqrt(N))
+    sobol,       // Owen打乱的Sobol序列，每个维度独立打乱和重排，见sampler
+};
+
+/// @brief 一个样本中各个用途使用的维度，每个维度最多取sampler::max_components个数
+/// 维度之间用不同的种子打乱，互不相关；弹射的维度按弹射次数分配，同一次弹射的用途固定在同一个维度
+namespace sample_dimension
+{
+    inline constexpr uint32_t pixel        = 0; // 像素内的位置，2个数
+    inline constexpr uint32_t lens         = 1; // 镜头上的位置，2个数
+    inline constexpr uint32_t time         = 2; // 快门时间，1个数
+    inline constexpr uint32_t first_bounce = 3;
+
+    /// @brief 每次弹射的用途
+    enum bounce_slot : uint32_t
+    {
+        light,    // 对光源采样，3个数
+        scatter,  // 按材质采样散射方向，3个数
+        roulette, // 俄罗斯轮盘赌，1个数
+        slots_per_bounce,
+    };
+
+    /// @brief 第depth次弹射（从0开始）的slot用途的维度
+    constexpr uint32_t bounce(int depth, bounce_slot slot) noexcept
+    {
+        return first_bounce + static_cast<uint32_t>(depth) * slots_per_bounce + slot;
+    }
+} // namespace sample_dimension
+
+namespace sobol_detail
+{
+    /// @brief 32位Sobol序列前4个维度的生成矩阵，第k列对应序号的第k位
+    /// 第0维是位反转（van der Corput），其余按Joe和Kuo的本原多项式和初始方向数构造
+    constexpr std::array<std::array<uint32_t, 32>, 4> make_matrices() noexcept
+    {
+        struct polynomial
+        {
+            uint32_t degree;
+            uint32_t coefficients;
+            uint32_t m[3];
+        };
+        constexpr polynomial polynomials[3] = { { 1, 0, { 1, 0, 0 } }, { 2, 1, { 1, 3, 0 } }, { 3, 1, { 1, 3, 1 } } };
+
+        std::array<std::array<uint32_t, 32>, 4> matrices {};
+        for (uint32_t k = 0; k < 32; ++k)
+        {
+            matrices[0][k] = 1u << (31 - k);
+        }
+        for (uint32_t d = 1; d < 4; ++d)
+        {
+            const auto& p = polynomials[d - 1];
+            auto& v       = matrices[d];
+            for (uint32_t k = 0; k < p.degree; ++k)
+            {
+                v[k] = p.m[k] << (31 - k);
+            }
+            for (uint32_t k = p.degree; k < 32; ++k)
+            {
+                v[k] = v[k - p.degree] ^ (v[k - p.degree] >> p.degree);
+                for (uint32_t j = 1; j < p.degree; ++j)
+                {
+                    if ((p.coefficients >> (p.degree - 1 - j)) & 1)
+                    {
+                        v[k] ^= v[k - j];
+                    }
+                }
+            }
+        }
+        return matrices;
+    }
+
+    inline constexpr auto matrices = make_matrices();
+
+    /// @brief Sobol序列第index个点的第dimension维（0到3）
+    constexpr uint32_t sobol(uint32_t index, uint32_t dimension) noexcept
+    {
+        uint32_t x = 0;
+        for (uint32_t k = 0; index != 0; index >>= 1, ++k)
+        {
+            if (index & 1)
+            {
+                x ^= matrices[dimension][k];
+            }
+        }
+        return x;
+    }
+
+    constexpr uint32_t reverse_bits(uint32_t x) noexcept
+    {
+        x = ((x >> 1) & 0x55555555u) | ((x & 0x55555555u) << 1);
+        x = ((x >> 2) & 0x33333333u) | ((x & 0x33333333u) << 2);
+        x = ((x >> 4) & 0x0f0f0f0fu) | ((x & 0x0f0f0f0fu) << 4);
+        x = ((x >> 8) & 0x00ff00ffu) | ((x & 0x00ff00ffu) << 8);
+        return (x >> 16) | (x << 16);
+    }
+
+    /// @brief 基于哈希的Owen打乱（Burley 2020）：位反转后，每一位只受更低位的影响（Laine-Karras置换），
+    /// 相当于按二叉树逐层随机交换子区间，打乱之后仍然是(0, m, 2)网
+    constexpr uint32_t nested_uniform_scramble(uint32_t x, uint32_t seed) noexcept
+    {
+        x = reverse_bits(x);
+        x ^= x * 0x3d20adeau;
+        x += seed;
+        x *= (seed >> 16) | 1;
+        x ^= x * 0x05526c56u;
+        x ^= x * 0x53a22864u;
+        return reverse_bits(x);
+    }
+} // namespace sobol_detail
+
+/// @brief 为每个样本提供[0, 1)上的随机数，渲染时每个线程持有一个，每个像素的每个样本调用一次start
+/// independent直接从thread_rng取数，与不使用采样器时的随机数序列相同；
+/// sobol的每个维度是前4维Sobol序列的一个独立副本：样本序号先用(像素, 维度)的种子打乱（重排样本的顺序），
+/// 再对每一维的值做Owen打乱，所以任意多个维度之间互不相关，每个维度内部仍然是低差异的，
+/// 像素之间的种子不同，误差在图像上是白噪声。样本数是2的幂时分层最好
+class sampler
+{
+public:
+    /// @brief 每个维度最多取的数的个数
+    static constexpr size_t max_components = 4;
+
+    explicit sampler(sampler_kind kind = sampler_kind::independent, uint64_t seed = 0) noexcept
+        : _kind(kind)
+        , _seed(seed)
+    {
+    }
+
+    sampler_kind kind() const noexcept
+    {
+        return _kind;
+    }
+
+    /// @brief 开始像素pixel的第sample_index个样本，随机数生成器的种子仍然由调用者设置
+    void start(uint64_t pixel, uint32_t sample_index) noexcept
+    {
+        _pixel_seed = hash_seed(_seed, pixel);
+        _index      = sample_index;
+    }
+
+    /// @brief 取出dimension维的out.size()个数，不超过max_components
+    void get(uint32_t dimension, std::span<double> out) noexcept
+    {
+        if (_kind == sampler_kind::independent)
+        {
+            thread_rng().fill(out);
+            return;
+        }
+
+        const auto seed  = hash_seed(_pixel_seed, dimension);
+        const auto index = sobol_detail::nested_uniform_scramble(_index, static_cast<uint32_t>(seed));
+        for (size_t c = 0; c < out.size() && c < max_components; ++c)
+        {
+            const auto x = sobol_detail::sobol(index, static_cast<uint32_t>(c));
+            out[c]       = sobol_detail::nested_uniform_scramble(x, static_cast<uint32_t>(hash_seed(seed, c))) * 0x1.0p-32;
+        }
+    }
+
+    double get_1d(uint32_t dimension) noexcept
+    {
+        double x;
+        get(dimension, std::span<double>(&x, 1));
+        return x;
+    }
+
+private:
+    sampler_kind _kind;
+    uint64_t _seed;
+    uint64_t _pixel_seed { 0 };
+    uint32_t _index { 0 };
+};
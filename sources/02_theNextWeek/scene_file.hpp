@@ -0,0 +1,634 @@
+#pragma once
+
+#include "mapped_file.hpp"
+#include "material.hpp"
+#include "rtweekend.hpp"
+#include "scenes.hpp"
+
+#include <bit>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+// 场景文件有两种格式，内容相同：
+//
+// 文本格式，用于手写和查看，每行一条记录，#之后是注释：
+//     lookfrom 13 2 3
+//     lookat 0 0 0
+//     vup 0 1 0
+//     vfov 20
+//     aperture 0.1
+//     focus_dist 10
+//     shutter 0 1
+//     lambertian 0.5 0.5 0.5            # 材质按出现的顺序编号，从0开始
+//     metal 0.7 0.6 0.5 0.0             # 反照率和模糊度
+//     dielectric 1.5                    # 折射率
+//     diffuse_light 15 15 15            # 发出的光
+//     glossy 0.2 0.3 0.7 0.2            # 底色和粗糙度
+//     sphere 0 -1000 0 1000 0           # 球心、半径、材质编号
+//     moving_sphere 0 0 0 0 0.5 0 0 1 0.2 0   # 两个时刻的球心、两个时刻、半径、材质编号
+//     quad 0 0 0 1 0 0 0 1 0 3          # 顶点、两条边、材质编号
+//
+// 二进制格式（小端），由scene_file_header、材质数组、球数组和四边形数组组成，所有数组按8字节对齐，
+// 加载时映射整个文件，直接按数组读取，除了场景自己的数组外没有任何分配
+
+/// @brief 二进制场景文件的标识
+inline constexpr char scene_file_magic[8] = { 'R', 'T', 'S', 'C', 'E', 'N', 'E', '\0' };
+inline constexpr uint32_t scene_file_version = 2;
+
+/// @brief 二进制场景文件的文件头
+struct scene_file_header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t material_count;
+    uint64_t sphere_count;
+    uint64_t material_offset; // 材质数组在文件中的偏移（字节）
+    uint64_t sphere_offset;   // 球数组在文件中的偏移（字节）
+    double lookfrom[3];
+    double lookat[3];
+    double vup[3];
+    double vfov;
+    double aperture;
+    double focus_dist;
+    double time0;
+    double time1;
+    uint64_t quad_count;
+    uint64_t quad_offset; // 四边形数组在文件中的偏移（字节）
+};
+
+/// @brief 二进制场景文件中的一个材质
+/// lambertian：params = 反照率；metal：params = 反照率、模糊度；dielectric：params[0] = 折射率；diffuse_light：params = 发出的光；glossy：params = 底色、粗糙度
+struct scene_file_material
+{
+    uint32_t kind; // material_kind
+    uint32_t reserved;
+    double params[4];
+};
+
+/// @brief 二进制场景文件中的一个球，静止的球两个时刻的球心相同
+struct scene_file_sphere
+{
+    double center0[3];
+    double center1[3];
+    double time0;
+    double time1;
+    double radius;
+    uint32_t material;
+    uint32_t reserved;
+};
+
+/// @brief 二进制场景文件中的一个四边形
+struct scene_file_quad
+{
+    double Q[3];
+    double u[3];
+    double v[3];
+    uint32_t material;
+    uint32_t reserved;
+};
+
+static_assert(std::is_trivially_copyable_v<scene_file_header> && sizeof(scene_file_header) % 8 == 0);
+static_assert(std::is_trivially_copyable_v<scene_file_material> && sizeof(scene_file_material) == 40);
+static_assert(std::is_trivially_copyable_v<scene_file_sphere> && sizeof(scene_file_sphere) == 80);
+static_assert(std::is_trivially_copyable_v<scene_file_quad> && sizeof(scene_file_quad) == 80);
+
+/// @brief 场景文件的格式，.bin为二进制格式，其他扩展名为文本格式
+inline bool is_binary_scene_path(std::string_view path) noexcept
+{
+    return path.ends_with(".bin");
+}
+
+inline scene_file_material to_file_material(const material& m) noexcept
+{
+    scene_file_material out {};
+    out.kind = static_cast<uint32_t>(m.index());
+    if (const auto l = std::get_if<lambertian>(&m))
+    {
+        out.params[0] = l->albedo.x();
+        out.params[1] = l->albedo.y();
+        out.params[2] = l->albedo.z();
+    }
+    else if (const auto mt = std::get_if<metal>(&m))
+    {
+        out.params[0] = mt->albedo.x();
+        out.params[1] = mt->albedo.y();
+        out.params[2] = mt->albedo.z();
+        out.params[3] = mt->fuzz;
+    }
+    else if (const auto d = std::get_if<dielectric>(&m))
+    {
+        out.params[0] = d->ref_idx;
+    }
+    else if (const auto e = std::get_if<diffuse_light>(&m))
+    {
+        out.params[0] = e->emit.x();
+        out.params[1] = e->emit.y();
+        out.params[2] = e->emit.z();
+    }
+    else if (const auto g = std::get_if<glossy>(&m))
+    {
+        out.params[0] = g->albedo.x();
+        out.params[1] = g->albedo.y();
+        out.params[2] = g->albedo.z();
+        out.params[3] = g->roughness;
+    }
+    return out;
+}
+
+inline material from_file_material(const scene_file_material& m) noexcept
+{
+    const vec3 albedo(m.params[0], m.params[1], m.params[2]);
+    switch (static_cast<material_kind>(m.kind))
+    {
+    case material_kind::metal:
+        return metal(albedo, m.params[3]);
+    case material_kind::dielectric:
+        return dielectric(m.params[0]);
+    case material_kind::diffuse_light:
+        return diffuse_light(albedo);
+    case material_kind::glossy:
+        return glossy(albedo, m.params[3]);
+    default:
+        return lambertian(albedo);
+    }
+}
+
+inline scene_file_sphere to_file_sphere(const sphere_soa& spheres, size_t i) noexcept
+{
+    vec3 center0, center1;
+    real time0, time1;
+    spheres.motion(i, center0, center1, time0, time1);
+
+    scene_file_sphere out {};
+    for (int a = 0; a < 3; ++a)
+    {
+        out.center0[a] = center0[a];
+        out.center1[a] = center1[a];
+    }
+    out.time0    = time0;
+    out.time1    = time1;
+    out.radius   = spheres.radius(i);
+    out.material = spheres.material(i);
+    return out;
+}
+
+inline scene_file_quad to_file_quad(const quad& q) noexcept
+{
+    scene_file_quad out {};
+    for (int a = 0; a < 3; ++a)
+    {
+        out.Q[a] = q.Q[a];
+        out.u[a] = q.u[a];
+        out.v[a] = q.v[a];
+    }
+    out.material = q.material_id;
+    return out;
+}
+
+/// @brief 以二进制格式保存场景
+inline bool save_scene_binary(const scene& s, const std::string& path)
+{
+    if constexpr (std::endian::native != std::endian::little)
+    {
+        return false;
+    }
+
+    std::ofstream file(path, std::ios::binary);
+    if (!file)
+    {
+        return false;
+    }
+
+    scene_file_header header {};
+    std::memcpy(header.magic, scene_file_magic, sizeof(header.magic));
+    header.version         = scene_file_version;
+    header.material_count  = s.materials.size();
+    header.sphere_count    = s.spheres->size();
+    header.material_offset = sizeof(scene_file_header);
+    header.sphere_offset   = header.material_offset + header.material_count * sizeof(scene_file_material);
+    header.quad_count      = s.quads.size();
+    header.quad_offset     = header.sphere_offset + header.sphere_count * sizeof(scene_file_sphere);
+    for (int a = 0; a < 3; ++a)
+    {
+        header.lookfrom[a] = s.lookfrom[a];
+        header.lookat[a]   = s.lookat[a];
+        header.vup[a]      = s.vup[a];
+    }
+    header.vfov       = s.vfov;
+    header.aperture   = s.aperture;
+    header.focus_dist = s.focus_dist;
+    header.time0      = s.time0;
+    header.time1      = s.time1;
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    for (uint32_t id = 0; id < s.materials.size(); ++id)
+    {
+        const auto m = to_file_material(s.materials[id]);
+        file.write(reinterpret_cast<const char*>(&m), sizeof(m));
+    }
+    for (size_t i = 0; i < s.spheres->size(); ++i)
+    {
+        const auto sphere = to_file_sphere(*s.spheres, i);
+        file.write(reinterpret_cast<const char*>(&sphere), sizeof(sphere));
+    }
+    for (const auto q : s.quads)
+    {
+        const auto record = to_file_quad(*q);
+        file.write(reinterpret_cast<const char*>(&record), sizeof(record));
+    }
+
+    return static_cast<bool>(file);
+}
+
+/// @brief 以文本格式保存场景，数值按能精确读回的精度写出
+inline bool save_scene_text(const scene& s, const std::string& path)
+{
+    std::ofstream file(path);
+    if (!file)
+    {
+        return false;
+    }
+    file.precision(std::numeric_limits<real>::max_digits10);
+
+    const auto put = [&](const vec3& v) { file << ' ' << v.x() << ' ' << v.y() << ' ' << v.z(); };
+
+    file << "lookfrom";
+    put(s.lookfrom);
+    file << "\nlookat";
+    put(s.lookat);
+    file << "\nvup";
+    put(s.vup);
+    file << "\nvfov " << s.vfov << "\naperture " << s.aperture << "\nfocus_dist " << s.focus_dist << "\nshutter " << s.time0 << ' ' << s.time1 << '\n';
+
+    for (uint32_t id = 0; id < s.materials.size(); ++id)
+    {
+        const auto& m = s.materials[id];
+        if (const auto l = std::get_if<lambertian>(&m))
+        {
+            file << "lambertian";
+            put(l->albedo);
+        }
+        else if (const auto mt = std::get_if<metal>(&m))
+        {
+            file << "metal";
+            put(mt->albedo);
+            file << ' ' << mt->fuzz;
+        }
+        else if (const auto d = std::get_if<dielectric>(&m))
+        {
+            file << "dielectric " << d->ref_idx;
+        }
+        else if (const auto e = std::get_if<diffuse_light>(&m))
+        {
+            file << "diffuse_light";
+            put(e->emit);
+        }
+        else if (const auto g = std::get_if<glossy>(&m))
+        {
+            file << "glossy";
+            put(g->albedo);
+            file << ' ' << g->roughness;
+        }
+        file << '\n';
+    }
+
+    for (size_t i = 0; i < s.spheres->size(); ++i)
+    {
+        vec3 center0, center1;
+        real time0, time1;
+        s.spheres->motion(i, center0, center1, time0, time1);
+        if (s.spheres->moving(i))
+        {
+            file << "moving_sphere";
+            put(center0);
+            put(center1);
+            file << ' ' << time0 << ' ' << time1;
+        }
+        else
+        {
+            file << "sphere";
+            put(center0);
+        }
+        file << ' ' << s.spheres->radius(i) << ' ' << s.spheres->material(i) << '\n';
+    }
+
+    for (const auto q : s.quads)
+    {
+        file << "quad";
+        put(q->Q);
+        put(q->u);
+        put(q->v);
+        file << ' ' << q->material_id << '\n';
+    }
+
+    return static_cast<bool>(file);
+}
+
+/// @brief 保存场景，格式由扩展名决定，见is_binary_scene_path
+inline bool save_scene(const scene& s, const std::string& path)
+{
+    return is_binary_scene_path(path) ? save_scene_binary(s, path) : save_scene_text(s, path);
+}
+
+/// @brief 从映射的二进制场景文件加载，检查所有偏移、数量和材质编号
+inline bool load_scene_binary(const uint8_t* data, size_t size, scene& out, std::string& error)
+{
+    if constexpr (std::endian::native != std::endian::little)
+    {
+        error = "binary scene files require a little-endian host";
+        return false;
+    }
+
+    scene_file_header header;
+    if (size < sizeof(header))
+    {
+        error = "truncated header";
+        return false;
+    }
+    std::memcpy(&header, data, sizeof(header));
+    if (std::memcmp(header.magic, scene_file_magic, sizeof(header.magic)) != 0 || header.version != scene_file_version)
+    {
+        error = "not a version " + std::to_string(scene_file_version) + " binary scene file";
+        return false;
+    }
+
+    const auto fits = [&](uint64_t offset, uint64_t count, uint64_t stride) {
+        return offset <= size && count <= (size - offset) / stride && offset % 8 == 0;
+    };
+    if (!fits(header.material_offset, header.material_count, sizeof(scene_file_material)) || !fits(header.sphere_offset, header.sphere_count, sizeof(scene_file_sphere))
+        || !fits(header.quad_offset, header.quad_count, sizeof(scene_file_quad)) || header.material_count > std::numeric_limits<uint32_t>::max())
+    {
+        error = "array out of bounds";
+        return false;
+    }
+
+    scene s;
+    s.lookfrom   = vec3(header.lookfrom[0], header.lookfrom[1], header.lookfrom[2]);
+    s.lookat     = vec3(header.lookat[0], header.lookat[1], header.lookat[2]);
+    s.vup        = vec3(header.vup[0], header.vup[1], header.vup[2]);
+    s.vfov       = static_cast<real>(header.vfov);
+    s.aperture   = static_cast<real>(header.aperture);
+    s.focus_dist = static_cast<real>(header.focus_dist);
+    s.time0      = static_cast<real>(header.time0);
+    s.time1      = static_cast<real>(header.time1);
+
+    s.materials.reserve(header.material_count);
+    const uint8_t* materials = data + header.material_offset;
+    for (uint64_t k = 0; k < header.material_count; ++k)
+    {
+        scene_file_material m;
+        std::memcpy(&m, materials + k * sizeof(m), sizeof(m));
+        if (m.kind >= material_kind_count)
+        {
+            error = "invalid material kind " + std::to_string(m.kind);
+            return false;
+        }
+        s.materials.add(from_file_material(m));
+    }
+
+    s.spheres->reserve(header.sphere_count);
+    const uint8_t* spheres = data + header.sphere_offset;
+    for (uint64_t k = 0; k < header.sphere_count; ++k)
+    {
+        scene_file_sphere sp;
+        std::memcpy(&sp, spheres + k * sizeof(sp), sizeof(sp));
+        if (sp.material >= header.material_count)
+        {
+            error = "sphere " + std::to_string(k) + " uses undefined material " + std::to_string(sp.material);
+            return false;
+        }
+        if (sp.time1 == sp.time0)
+        {
+            error = "sphere " + std::to_string(k) + " has an empty time range";
+            return false;
+        }
+        s.spheres->add(vec3(sp.center0[0], sp.center0[1], sp.center0[2]), vec3(sp.center1[0], sp.center1[1], sp.center1[2]), static_cast<real>(sp.time0),
+            static_cast<real>(sp.time1), static_cast<real>(sp.radius), sp.material);
+    }
+
+    s.quads.reserve(header.quad_count);
+    const uint8_t* quads = data + header.quad_offset;
+    for (uint64_t k = 0; k < header.quad_count; ++k)
+    {
+        scene_file_quad q;
+        std::memcpy(&q, quads + k * sizeof(q), sizeof(q));
+        if (q.material >= header.material_count)
+        {
+            error = "quad " + std::to_string(k) + " uses undefined material " + std::to_string(q.material);
+            return false;
+        }
+        const vec3 u(q.u[0], q.u[1], q.u[2]);
+        const vec3 v(q.v[0], q.v[1], q.v[2]);
+        if (!(cross(u, v).length_squared() > 0))
+        {
+            error = "quad " + std::to_string(k) + " is degenerate";
+            return false;
+        }
+        s.add_quad(vec3(q.Q[0], q.Q[1], q.Q[2]), u, v, q.material);
+    }
+
+    if (!s.valid_camera(error))
+    {
+        error = "invalid camera: " + error;
+        return false;
+    }
+
+    out = std::move(s);
+    return true;
+}
+
+/// @brief 从文本场景文件加载
+inline bool load_scene_text(std::string_view text, scene& out, std::string& error)
+{
+    scene s;
+    size_t line_number = 0;
+
+    while (!text.empty())
+    {
+        ++line_number;
+        const auto eol        = text.find('\n');
+        std::string_view line = text.substr(0, eol);
+        text.remove_prefix(eol == std::string_view::npos ? text.size() : eol + 1);
+
+        if (const auto comment = line.find('#'); comment != std::string_view::npos)
+        {
+            line = line.substr(0, comment);
+        }
+
+        // 依次取出空白分隔的字段
+        const auto next_token = [&]() {
+            const auto first = line.find_first_not_of(" \t\r");
+            if (first == std::string_view::npos)
+            {
+                line = {};
+                return std::string_view();
+            }
+            line.remove_prefix(first);
+            const auto last  = std::min(line.find_first_of(" \t\r"), line.size());
+            const auto token = line.substr(0, last);
+            line.remove_prefix(last);
+            return token;
+        };
+
+        bool valid        = true;
+        const auto number = [&]() {
+            const auto token = next_token();
+            double value     = 0;
+            const auto end   = token.data() + token.size();
+            const auto r     = std::from_chars(token.data(), end, value);
+            valid &= !token.empty() && r.ec == std::errc() && r.ptr == end;
+            return value;
+        };
+        const auto vector = [&]() {
+            const auto x = number();
+            const auto y = number();
+            const auto z = number();
+            return vec3(x, y, z);
+        };
+        const auto material_id = [&]() {
+            const auto id = number();
+            valid &= id >= 0 && id < s.materials.size() && id == static_cast<uint32_t>(id);
+            return static_cast<uint32_t>(id);
+        };
+
+        const auto keyword = next_token();
+        if (keyword.empty())
+        {
+            continue;
+        }
+
+        if (keyword == "sphere")
+        {
+            const auto center = vector();
+            const auto radius = number();
+            const auto id     = material_id();
+            if (valid)
+            {
+                s.spheres->add(center, static_cast<real>(radius), id);
+            }
+        }
+        else if (keyword == "moving_sphere")
+        {
+            const auto center0 = vector();
+            const auto center1 = vector();
+            const auto time0   = number();
+            const auto time1   = number();
+            const auto radius  = number();
+            const auto id      = material_id();
+            valid &= time1 != time0;
+            if (valid)
+            {
+                s.spheres->add(center0, center1, static_cast<real>(time0), static_cast<real>(time1), static_cast<real>(radius), id);
+            }
+        }
+        else if (keyword == "quad")
+        {
+            const auto Q  = vector();
+            const auto u  = vector();
+            const auto v  = vector();
+            const auto id = material_id();
+            valid &= cross(u, v).length_squared() > 0;
+            if (valid)
+            {
+                s.add_quad(Q, u, v, id);
+            }
+        }
+        else if (keyword == "lambertian")
+        {
+            s.materials.add(lambertian(vector()));
+        }
+        else if (keyword == "metal")
+        {
+            const auto albedo = vector();
+            s.materials.add(metal(albedo, static_cast<real>(number())));
+        }
+        else if (keyword == "dielectric")
+        {
+            s.materials.add(dielectric(static_cast<real>(number())));
+        }
+        else if (keyword == "diffuse_light")
+        {
+            s.materials.add(diffuse_light(vector()));
+        }
+        else if (keyword == "glossy")
+        {
+            const auto albedo = vector();
+            s.materials.add(glossy(albedo, static_cast<real>(number())));
+        }
+        else if (keyword == "lookfrom")
+        {
+            s.lookfrom = vector();
+        }
+        else if (keyword == "lookat")
+        {
+            s.lookat = vector();
+        }
+        else if (keyword == "vup")
+        {
+            s.vup = vector();
+        }
+        else if (keyword == "vfov")
+        {
+            s.vfov = static_cast<real>(number());
+        }
+        else if (keyword == "aperture")
+        {
+            s.aperture = static_cast<real>(number());
+        }
+        else if (keyword == "focus_dist")
+        {
+            s.focus_dist = static_cast<real>(number());
+        }
+        else if (keyword == "shutter")
+        {
+            s.time0 = static_cast<real>(number());
+            s.time1 = static_cast<real>(number());
+        }
+        else
+        {
+            error = "line " + std::to_string(line_number) + ": unknown keyword " + std::string(keyword);
+            return false;
+        }
+
+        if (!valid || !next_token().empty())
+        {
+            error = "line " + std::to_string(line_number) + ": invalid " + std::string(keyword);
+            return false;
+        }
+    }
+
+    if (!s.valid_camera(error))
+    {
+        error = "invalid camera: " + error;
+        return false;
+    }
+
+    out = std::move(s);
+    return true;
+}
+
+/// @brief 加载场景文件，按文件头识别二进制格式，否则按文本格式解析
+/// @param error 失败时写入错误信息
+inline bool load_scene(const std::string& path, scene& out, std::string& error)
+{
+    mapped_file file;
+    if (!file.open(path))
+    {
+        error = "cannot open " + path;
+        return false;
+    }
+
+    const bool binary = file.size() >= sizeof(scene_file_magic) && std::memcmp(file.data(), scene_file_magic, sizeof(scene_file_magic)) == 0;
+    if (binary)
+    {
+        return load_scene_binary(file.data(), file.size(), out, error);
+    }
+    return load_scene_text(std::string_view(reinterpret_cast<const char*>(file.data()), file.size()), out, error);
+}
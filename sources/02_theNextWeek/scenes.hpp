@@ -0,0 +1,319 @@
+#pragma once
+
+#include "arena.hpp"
+#include "camera.hpp"
+#include "hittable_list.hpp"
+#include "light.hpp"
+#include "material.hpp"
+#include "quad.hpp"
+#include "rtweekend.hpp"
+#include "sphere_soa.hpp"
+
+#include <charconv>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+/// @brief 场景：所有的球、四边形、材质表和相机参数
+/// 场景函数只添加物体，渲染前调用build构建BVH并收集光源，这样可以单独统计BVH的构建时间
+/// 场景中的物体都分配在objects中，与场景一起销毁，其他物体（sphere、bvh_node等）也可以分配在这里
+struct scene
+{
+    arena objects;
+    sphere_soa* spheres { objects.make<sphere_soa>() };
+    std::vector<const quad*> quads; // 四边形不多（墙、面光源），不放进BVH
+    material_table materials;
+    light_list lights; // 发光的球和四边形，build时收集
+
+    vec3 lookfrom { 13, 2, 3 };
+    vec3 lookat { 0, 0, 0 };
+    vec3 vup { 0, 1, 0 };
+    real vfov { 20 }; // 垂直视场角（度）
+    real aperture { 0 };
+    real focus_dist { 10 };
+    real time0 { 0 }; // 快门打开时间
+    real time1 { 1 }; // 快门关闭时间
+
+    /// @brief 添加一个四边形，见quad
+    void add_quad(const vec3& Q, const vec3& u, const vec3& v, uint32_t material)
+    {
+        quads.push_back(objects.make<quad>(Q, u, v, material));
+    }
+
+    /// @brief 构建BVH，默认使用SAH
+    void build(const bvh_build_options& options = {})
+    {
+        spheres->build(time0, time1, options);
+        build_lights();
+    }
+
+    /// @brief 收集发光的物体，build和build_cached会调用
+    void build_lights()
+    {
+        lights.build(*spheres, quads, materials);
+    }
+
+    /// @brief 所有物体组成的列表，球在一个sphere_soa中
+    hittable_list world() const
+    {
+        hittable_list list(spheres);
+        for (const auto q : quads)
+        {
+            list.add(q);
+        }
+        return list;
+    }
+
+    /// @brief sphere_soa之外的物体
+    hittable_list surfaces() const
+    {
+        hittable_list list;
+        for (const auto q : quads)
+        {
+            list.add(q);
+        }
+        return list;
+    }
+
+    /// @brief 构建BVH，使用cache_dir中的缓存
+    /// 缓存文件名是sphere_soa::bvh_key的十六进制，存在时直接映射，否则构建后写入，场景或构建参数改变时自动使用新的文件
+    /// @return 是否从缓存加载
+    bool build_cached(const std::string& cache_dir, const bvh_build_options& options = {})
+    {
+        const uint64_t key = spheres->bvh_key(time0, time1, options);
+
+        char name[32];
+        std::snprintf(name, sizeof(name), "%016llx.bvh", static_cast<unsigned long long>(key));
+        const auto path = (std::filesystem::path(cache_dir) / name).string();
+
+        if (spheres->load_bvh(path, key))
+        {
+            build_lights();
+            return true;
+        }
+
+        build(options);
+
+        std::error_code ec;
+        std::filesystem::create_directories(cache_dir, ec);
+        if (!spheres->save_bvh(path, key))
+        {
+            std::cerr << "Failed to write BVH cache " << path << '\n';
+        }
+        return false;
+    }
+
+    /// @brief 相机参数是否合法，见valid_camera
+    bool valid_camera(std::string& error) const
+    {
+        return ::valid_camera(lookfrom, lookat, vup, vfov, aperture, focus_dist, error);
+    }
+
+    camera make_camera(real aspect) const
+    {
+        return camera(lookfrom, lookat, vup, vfov, aspect, aperture, focus_dist, time0, time1);
+    }
+};
+
+/// @brief 添加一个随机材质的小球，材质的概率与两本书中的random_scene相同
+/// @param choose_mat [0, 1)上的随机数，决定材质的种类
+/// @param moving 漫反射的球是否向上运动（The Next Week）
+inline void add_random_sphere(scene& s, const vec3& center, double choose_mat, bool moving)
+{
+    if (choose_mat < 0.8)
+    {
+        // diffuse
+        auto albedo = vec3::random() * vec3::random();
+        if (moving)
+        {
+            auto center1 = center + vec3(0, random_double(0, .5), 0);
+            s.spheres->add(center, center1, 0.0, 1.0, 0.2, s.materials.add(lambertian(albedo)));
+        }
+        else
+        {
+            s.spheres->add(center, 0.2, s.materials.add(lambertian(albedo)));
+        }
+    }
+    else if (choose_mat < 0.95)
+    {
+        // metal
+        auto albedo = vec3::random(.5, 1);
+        auto fuzz   = random_double(0, .5);
+        s.spheres->add(center, 0.2, s.materials.add(metal(albedo, fuzz)));
+    }
+    else
+    {
+        // glass
+        s.spheres->add(center, 0.2, s.materials.add(dielectric(1.5)));
+    }
+}
+
+/// @brief 三个大球
+inline void add_feature_spheres(scene& s)
+{
+    s.spheres->add(vec3(0, 1, 0), 1.0, s.materials.add(dielectric(1.5)));
+    s.spheres->add(vec3(-4, 1, 0), 1.0, s.materials.add(lambertian(vec3(0.4, 0.2, 0.1))));
+    s.spheres->add(vec3(4, 1, 0), 1.0, s.materials.add(metal(vec3(0.7, 0.6, 0.5), 0.0)));
+}
+
+/// @brief In One Weekend最后的场景：静止的小球，相机有景深
+inline scene in_one_weekend_scene()
+{
+    scene s;
+    s.aperture = 0.1;
+    s.time1    = 0;
+
+    s.spheres->add(vec3(0, -1000, 0), 1000, s.materials.add(lambertian(vec3(0.5, 0.5, 0.5))));
+
+    for (int a = -11; a < 11; a++)
+    {
+        for (int b = -11; b < 11; b++)
+        {
+            auto choose_mat = random_double();
+            vec3 center(a + 0.9 * random_double(), 0.2, b + 0.9 * random_double());
+            if ((center - vec3(4, 0.2, 0)).length() > 0.9)
+            {
+                add_random_sphere(s, center, choose_mat, false);
+            }
+        }
+    }
+
+    add_feature_spheres(s);
+    return s;
+}
+
+/// @brief The Next Week第一章的场景：漫反射的小球在快门时间内向上运动
+inline scene the_next_week_scene()
+{
+    scene s;
+
+    s.spheres->add(vec3(0, -1000, 0), 1000, s.materials.add(lambertian(vec3(0.5, 0.5, 0.5))));
+
+    for (int a = -10; a < 10; a++)
+    {
+        for (int b = -10; b < 10; b++)
+        {
+            auto choose_mat = random_double();
+            vec3 center(a + 0.9 * random_double(), 0.2, b + 0.9 * random_double());
+            if ((center - vec3(4, .2, 0)).length() > 0.9)
+            {
+                add_random_sphere(s, center, choose_mat, true);
+            }
+        }
+    }
+
+    add_feature_spheres(s);
+    return s;
+}
+
+/// @brief 放大的the_next_week_scene，count个小球按网格分布在以原点为中心的正方形区域内，密度与原场景相同
+inline scene sphere_field_scene(size_t count)
+{
+    scene s;
+
+    s.spheres->add(vec3(0, -1000, 0), 1000, s.materials.add(lambertian(vec3(0.5, 0.5, 0.5))));
+
+    const auto side = static_cast<size_t>(std::ceil(std::sqrt(static_cast<double>(count))));
+    for (size_t k = 0; k < count; ++k)
+    {
+        const auto a    = static_cast<double>(k % side) - side / 2.0;
+        const auto b    = static_cast<double>(k / side) - side / 2.0;
+        auto choose_mat = random_double();
+        vec3 center(a + 0.9 * random_double(), 0.2, b + 0.9 * random_double());
+        add_random_sphere(s, center, choose_mat, true);
+    }
+
+    add_feature_spheres(s);
+    return s;
+}
+
+/// @brief 室内场景：封闭的Cornell box，天花板上一块四边形光源，地上一个小的发光球、一个光泽球和一个金属球，相机在盒子里面，
+/// 场景只被这两个光源照亮，用于比较对光源直接采样与只靠散射光线击中光源的噪声
+inline scene cornell_box_scene()
+{
+    scene s;
+    s.lookfrom = vec3(278, 278, -590);
+    s.lookat   = vec3(278, 278, 0);
+    s.vfov     = 40;
+    s.time1    = 0;
+
+    const auto red   = s.materials.add(lambertian(vec3(.65, .05, .05)));
+    const auto white = s.materials.add(lambertian(vec3(.73, .73, .73)));
+    const auto green = s.materials.add(lambertian(vec3(.12, .45, .15)));
+    const auto light = s.materials.add(diffuse_light(vec3(15, 15, 15)));
+
+    // 墙从相机后面的z = -600延伸到z = 555，所有面都在盒子里面可见
+    const real front = -600;
+    const real depth = 555 - front;
+    s.add_quad(vec3(555, 0, front), vec3(0, 555, 0), vec3(0, 0, depth), green);
+    s.add_quad(vec3(0, 0, front), vec3(0, 555, 0), vec3(0, 0, depth), red);
+    s.add_quad(vec3(0, 0, front), vec3(555, 0, 0), vec3(0, 0, depth), white);
+    s.add_quad(vec3(0, 555, front), vec3(555, 0, 0), vec3(0, 0, depth), white);
+    s.add_quad(vec3(0, 0, 555), vec3(555, 0, 0), vec3(0, 555, 0), white);
+    s.add_quad(vec3(0, 0, front), vec3(555, 0, 0), vec3(0, 555, 0), white);
+    // 法线cross(u, v)朝下
+    s.add_quad(vec3(343, 554, 332), vec3(-130, 0, 0), vec3(0, 0, -105), light);
+
+    s.spheres->add(vec3(190, 90, 190), 90, s.materials.add(glossy(vec3(.2, .3, .7), 0.2)));
+    s.spheres->add(vec3(380, 100, 380), 100, s.materials.add(metal(vec3(.8, .85, .88), 0.0)));
+    s.spheres->add(vec3(420, 40, 120), 40, s.materials.add(diffuse_light(vec3(6, 4, 2))));
+    return s;
+}
+
+/// @brief 按名字生成场景：in_one_weekend、the_next_week、cornell_box或spheres_<数量>（数量可以带k、m后缀，例如spheres_100k）
+/// @return 名字无效时返回false
+inline bool make_scene(std::string_view name, scene& out)
+{
+    if (name == "in_one_weekend")
+    {
+        out = in_one_weekend_scene();
+        return true;
+    }
+    if (name == "the_next_week")
+    {
+        out = the_next_week_scene();
+        return true;
+    }
+    if (name == "cornell_box")
+    {
+        out = cornell_box_scene();
+        return true;
+    }
+
+    constexpr std::string_view prefix = "spheres_";
+    if (!name.starts_with(prefix))
+    {
+        return false;
+    }
+
+    auto count_text = name.substr(prefix.size());
+    size_t scale    = 1;
+    if (count_text.ends_with('k'))
+    {
+        scale = 1'000;
+    }
+    else if (count_text.ends_with('m'))
+    {
+        scale = 1'000'000;
+    }
+    if (scale != 1)
+    {
+        count_text.remove_suffix(1);
+    }
+
+    size_t count     = 0;
+    const auto last  = count_text.data() + count_text.size();
+    const auto value = std::from_chars(count_text.data(), last, count);
+    if (count_text.empty() || value.ec != std::errc() || value.ptr != last || count == 0)
+    {
+        return false;
+    }
+
+    out = sphere_field_scene(count * scale);
+    return true;
+}
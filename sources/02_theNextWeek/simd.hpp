@@ -0,0 +1,471 @@
+#pragma once
+
+#include "rtweekend.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+
+// 编译时选择SIMD实现：RT_SIMD_LEVEL 2为AVX2，1为SSE2，0为标量实现
+// CMake选项RT_ENABLE_AVX2会打开-mavx2（/arch:AVX2），x86-64上SSE2总是可用的
+// 不打开FMA，避免编译器把标量代码中的乘加合并，导致与SIMD内核的结果不一致
+#if !defined(RT_SIMD_LEVEL)
+#if defined(__AVX2__)
+#define RT_SIMD_LEVEL 2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define RT_SIMD_LEVEL 1
+#else
+#define RT_SIMD_LEVEL 0
+#endif
+#endif
+
+#if RT_SIMD_LEVEL >= 2
+#include <immintrin.h>
+#elif RT_SIMD_LEVEL >= 1
+#include <emmintrin.h>
+#endif
+
+/// @brief 一次测试的包围盒（或光线）数量：AVX2为8，其他为4
+#if RT_SIMD_LEVEL >= 2
+constexpr int simd_width = 8;
+#else
+constexpr int simd_width = 4;
+#endif
+
+/// @brief float求交结果向外放大的系数，抵消float舍入误差，保证不会漏掉相交（pbrt中的1 + 2 * gamma(3)）
+constexpr float simd_float_robust_scale = 1.0f + 2.0f * (3.0f * 0x1.0p-24f) / (1.0f - 3.0f * 0x1.0p-24f);
+
+/// @brief 遍历时预先计算好的光线数据，每条光线只计算一次方向的倒数
+/// 第4个分量用于补齐SIMD寄存器
+struct alignas(32) ray_traversal_data
+{
+    double origin[4];
+    double inv_dir[4];
+    float origin_f[4];
+    float inv_dir_f[4];
+    int dir_is_neg[3];
+
+    /// @brief 未初始化，用于光线包中的数组
+    ray_traversal_data() noexcept = default;
+
+    explicit ray_traversal_data(const ray& r) noexcept
+    {
+        for (size_t i = 0; i < 3; ++i)
+        {
+            origin[i]     = r.origin()[i];
+            inv_dir[i]    = 1.0 / r.direction()[i];
+            origin_f[i]   = static_cast<float>(origin[i]);
+            inv_dir_f[i]  = static_cast<float>(inv_dir[i]);
+            dir_is_neg[i] = inv_dir[i] < 0;
+        }
+        origin[3] = inv_dir[3] = 0.0;
+        origin_f[3] = inv_dir_f[3] = 0.0f;
+    }
+};
+
+/// @brief 单条光线与单个包围盒求交，三个轴同时计算，没有分支
+/// @param bounds_min 包围盒最小点，至少可以读取4个float（第4个值不参与计算）
+/// @param bounds_max 包围盒最大点，至少可以读取4个float（第4个值不参与计算）
+/// @param t_entry 相交时为进入包围盒的参数
+inline bool intersect_box(const float* bounds_min, const float* bounds_max, const ray_traversal_data& rd, double tmin, double tmax, double& t_entry) noexcept
+{
+#if RT_SIMD_LEVEL >= 2
+    const __m256d o   = _mm256_load_pd(rd.origin);
+    const __m256d inv = _mm256_load_pd(rd.inv_dir);
+    const __m256d t0  = _mm256_mul_pd(_mm256_sub_pd(_mm256_cvtps_pd(_mm_loadu_ps(bounds_min)), o), inv);
+    const __m256d t1  = _mm256_mul_pd(_mm256_sub_pd(_mm256_cvtps_pd(_mm_loadu_ps(bounds_max)), o), inv);
+
+    // 第4个分量用tmin/tmax替换，不影响结果
+    __m256d tn = _mm256_blend_pd(_mm256_min_pd(t0, t1), _mm256_set1_pd(tmin), 0b1000);
+    __m256d tf = _mm256_blend_pd(_mm256_max_pd(t0, t1), _mm256_set1_pd(tmax), 0b1000);
+    tn         = _mm256_max_pd(tn, _mm256_set1_pd(tmin));
+    tf         = _mm256_min_pd(tf, _mm256_set1_pd(tmax));
+
+    __m128d n = _mm_max_pd(_mm256_castpd256_pd128(tn), _mm256_extractf128_pd(tn, 1));
+    __m128d f = _mm_min_pd(_mm256_castpd256_pd128(tf), _mm256_extractf128_pd(tf, 1));
+    n         = _mm_max_sd(n, _mm_unpackhi_pd(n, n));
+    f         = _mm_min_sd(f, _mm_unpackhi_pd(f, f));
+
+    t_entry = _mm_cvtsd_f64(n);
+    return t_entry <= _mm_cvtsd_f64(f);
+#elif RT_SIMD_LEVEL >= 1
+    const __m128 lo = _mm_loadu_ps(bounds_min);
+    const __m128 hi = _mm_loadu_ps(bounds_max);
+
+    // xy和z两组分别计算
+    const __m128d t0_xy = _mm_mul_pd(_mm_sub_pd(_mm_cvtps_pd(lo), _mm_load_pd(rd.origin)), _mm_load_pd(rd.inv_dir));
+    const __m128d t1_xy = _mm_mul_pd(_mm_sub_pd(_mm_cvtps_pd(hi), _mm_load_pd(rd.origin)), _mm_load_pd(rd.inv_dir));
+    const __m128d t0_z  = _mm_mul_sd(_mm_sub_sd(_mm_cvtps_pd(_mm_movehl_ps(lo, lo)), _mm_load_sd(rd.origin + 2)), _mm_load_sd(rd.inv_dir + 2));
+    const __m128d t1_z  = _mm_mul_sd(_mm_sub_sd(_mm_cvtps_pd(_mm_movehl_ps(hi, hi)), _mm_load_sd(rd.origin + 2)), _mm_load_sd(rd.inv_dir + 2));
+
+    __m128d n = _mm_max_pd(_mm_min_pd(t0_xy, t1_xy), _mm_set1_pd(tmin));
+    __m128d f = _mm_min_pd(_mm_max_pd(t0_xy, t1_xy), _mm_set1_pd(tmax));
+    n         = _mm_max_sd(n, _mm_unpackhi_pd(n, n));
+    f         = _mm_min_sd(f, _mm_unpackhi_pd(f, f));
+    n         = _mm_max_sd(n, _mm_min_sd(t0_z, t1_z));
+    f         = _mm_min_sd(f, _mm_max_sd(t0_z, t1_z));
+
+    t_entry = _mm_cvtsd_f64(n);
+    return t_entry <= _mm_cvtsd_f64(f);
+#else
+    for (size_t i = 0; i < 3; ++i)
+    {
+        const double t0 = (bounds_min[i] - rd.origin[i]) * rd.inv_dir[i];
+        const double t1 = (bounds_max[i] - rd.origin[i]) * rd.inv_dir[i];
+        tmin            = ffmax(ffmin(t0, t1), tmin);
+        tmax            = ffmin(ffmax(t0, t1), tmax);
+    }
+
+    t_entry = tmin;
+    return tmin <= tmax;
+#endif
+}
+
+/// @brief 单条光线与运动的包围盒求交，包围盒为box0和box1按u线性插值，插值用double计算
+/// @param min0 u = 0时包围盒的最小点，与max0、min1、max1一样至少可以读取4个float（第4个值不参与计算）
+/// @param t_entry 相交时为进入包围盒的参数
+inline bool intersect_motion_box(const float* min0, const float* max0, const float* min1, const float* max1, double u, const ray_traversal_data& rd, double tmin,
+                                 double tmax, double& t_entry) noexcept
+{
+#if RT_SIMD_LEVEL >= 2
+    const __m256d o    = _mm256_load_pd(rd.origin);
+    const __m256d inv  = _mm256_load_pd(rd.inv_dir);
+    const __m256d w    = _mm256_set1_pd(u);
+    const __m256d lo0  = _mm256_cvtps_pd(_mm_loadu_ps(min0));
+    const __m256d hi0  = _mm256_cvtps_pd(_mm_loadu_ps(max0));
+    const __m256d lo   = _mm256_add_pd(lo0, _mm256_mul_pd(w, _mm256_sub_pd(_mm256_cvtps_pd(_mm_loadu_ps(min1)), lo0)));
+    const __m256d hi   = _mm256_add_pd(hi0, _mm256_mul_pd(w, _mm256_sub_pd(_mm256_cvtps_pd(_mm_loadu_ps(max1)), hi0)));
+    const __m256d t0   = _mm256_mul_pd(_mm256_sub_pd(lo, o), inv);
+    const __m256d t1   = _mm256_mul_pd(_mm256_sub_pd(hi, o), inv);
+
+    // 第4个分量用tmin/tmax替换，不影响结果
+    __m256d tn = _mm256_blend_pd(_mm256_min_pd(t0, t1), _mm256_set1_pd(tmin), 0b1000);
+    __m256d tf = _mm256_blend_pd(_mm256_max_pd(t0, t1), _mm256_set1_pd(tmax), 0b1000);
+    tn         = _mm256_max_pd(tn, _mm256_set1_pd(tmin));
+    tf         = _mm256_min_pd(tf, _mm256_set1_pd(tmax));
+
+    __m128d n = _mm_max_pd(_mm256_castpd256_pd128(tn), _mm256_extractf128_pd(tn, 1));
+    __m128d f = _mm_min_pd(_mm256_castpd256_pd128(tf), _mm256_extractf128_pd(tf, 1));
+    n         = _mm_max_sd(n, _mm_unpackhi_pd(n, n));
+    f         = _mm_min_sd(f, _mm_unpackhi_pd(f, f));
+
+    t_entry = _mm_cvtsd_f64(n);
+    return t_entry <= _mm_cvtsd_f64(f);
+#elif RT_SIMD_LEVEL >= 1
+    const __m128 lo0 = _mm_loadu_ps(min0);
+    const __m128 hi0 = _mm_loadu_ps(max0);
+    const __m128 lo1 = _mm_loadu_ps(min1);
+    const __m128 hi1 = _mm_loadu_ps(max1);
+    const __m128d w  = _mm_set1_pd(u);
+
+    // xy和z两组分别插值和计算
+    const auto lerp = [&](__m128d a, __m128d b) { return _mm_add_pd(a, _mm_mul_pd(w, _mm_sub_pd(b, a))); };
+    const __m128d lo_xy = lerp(_mm_cvtps_pd(lo0), _mm_cvtps_pd(lo1));
+    const __m128d hi_xy = lerp(_mm_cvtps_pd(hi0), _mm_cvtps_pd(hi1));
+    const __m128d lo_z  = lerp(_mm_cvtps_pd(_mm_movehl_ps(lo0, lo0)), _mm_cvtps_pd(_mm_movehl_ps(lo1, lo1)));
+    const __m128d hi_z  = lerp(_mm_cvtps_pd(_mm_movehl_ps(hi0, hi0)), _mm_cvtps_pd(_mm_movehl_ps(hi1, hi1)));
+
+    const __m128d t0_xy = _mm_mul_pd(_mm_sub_pd(lo_xy, _mm_load_pd(rd.origin)), _mm_load_pd(rd.inv_dir));
+    const __m128d t1_xy = _mm_mul_pd(_mm_sub_pd(hi_xy, _mm_load_pd(rd.origin)), _mm_load_pd(rd.inv_dir));
+    const __m128d t0_z  = _mm_mul_sd(_mm_sub_sd(lo_z, _mm_load_sd(rd.origin + 2)), _mm_load_sd(rd.inv_dir + 2));
+    const __m128d t1_z  = _mm_mul_sd(_mm_sub_sd(hi_z, _mm_load_sd(rd.origin + 2)), _mm_load_sd(rd.inv_dir + 2));
+
+    __m128d n = _mm_max_pd(_mm_min_pd(t0_xy, t1_xy), _mm_set1_pd(tmin));
+    __m128d f = _mm_min_pd(_mm_max_pd(t0_xy, t1_xy), _mm_set1_pd(tmax));
+    n         = _mm_max_sd(n, _mm_unpackhi_pd(n, n));
+    f         = _mm_min_sd(f, _mm_unpackhi_pd(f, f));
+    n         = _mm_max_sd(n, _mm_min_sd(t0_z, t1_z));
+    f         = _mm_min_sd(f, _mm_max_sd(t0_z, t1_z));
+
+    t_entry = _mm_cvtsd_f64(n);
+    return t_entry <= _mm_cvtsd_f64(f);
+#else
+    for (size_t i = 0; i < 3; ++i)
+    {
+        const double lo = min0[i] + u * (double(min1[i]) - min0[i]);
+        const double hi = max0[i] + u * (double(max1[i]) - max0[i]);
+        const double t0 = (lo - rd.origin[i]) * rd.inv_dir[i];
+        const double t1 = (hi - rd.origin[i]) * rd.inv_dir[i];
+        tmin            = ffmax(ffmin(t0, t1), tmin);
+        tmax            = ffmin(ffmax(t0, t1), tmax);
+    }
+
+    t_entry = tmin;
+    return tmin <= tmax;
+#endif
+}
+
+/// @brief simd_width个包围盒，按结构数组（SoA）存储
+struct alignas(32) box_packet
+{
+    float min[3][simd_width];
+    float max[3][simd_width];
+
+    /// @brief 把所有包围盒设为空盒（min > max），空位永远不会相交
+    void clear() noexcept
+    {
+        for (int a = 0; a < 3; ++a)
+        {
+            for (int i = 0; i < simd_width; ++i)
+            {
+                min[a][i] = std::numeric_limits<float>::infinity();
+                max[a][i] = -std::numeric_limits<float>::infinity();
+            }
+        }
+    }
+};
+
+/// @brief 单条光线同时与simd_width个包围盒求交
+/// @param t_entry 每个包围盒的进入参数
+/// @return 相交的包围盒的位掩码
+inline uint32_t intersect_box_packet(const ray_traversal_data& rd, const box_packet& boxes, double tmin, double tmax, float* t_entry) noexcept
+{
+#if RT_SIMD_LEVEL >= 2
+    __m256 tn = _mm256_set1_ps(static_cast<float>(tmin));
+    __m256 tf = _mm256_set1_ps(static_cast<float>(tmax));
+    for (int a = 0; a < 3; ++a)
+    {
+        const __m256 o   = _mm256_set1_ps(rd.origin_f[a]);
+        const __m256 inv = _mm256_set1_ps(rd.inv_dir_f[a]);
+        const __m256 t0  = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(boxes.min[a]), o), inv);
+        const __m256 t1  = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(boxes.max[a]), o), inv);
+        tn               = _mm256_max_ps(tn, _mm256_min_ps(t0, t1));
+        tf               = _mm256_min_ps(tf, _mm256_mul_ps(_mm256_max_ps(t0, t1), _mm256_set1_ps(simd_float_robust_scale)));
+    }
+    _mm256_storeu_ps(t_entry, tn);
+    return static_cast<uint32_t>(_mm256_movemask_ps(_mm256_cmp_ps(tn, tf, _CMP_LE_OQ)));
+#elif RT_SIMD_LEVEL >= 1
+    __m128 tn = _mm_set1_ps(static_cast<float>(tmin));
+    __m128 tf = _mm_set1_ps(static_cast<float>(tmax));
+    for (int a = 0; a < 3; ++a)
+    {
+        const __m128 o   = _mm_set1_ps(rd.origin_f[a]);
+        const __m128 inv = _mm_set1_ps(rd.inv_dir_f[a]);
+        const __m128 t0  = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(boxes.min[a]), o), inv);
+        const __m128 t1  = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(boxes.max[a]), o), inv);
+        tn               = _mm_max_ps(tn, _mm_min_ps(t0, t1));
+        tf               = _mm_min_ps(tf, _mm_mul_ps(_mm_max_ps(t0, t1), _mm_set1_ps(simd_float_robust_scale)));
+    }
+    _mm_storeu_ps(t_entry, tn);
+    return static_cast<uint32_t>(_mm_movemask_ps(_mm_cmple_ps(tn, tf)));
+#else
+    uint32_t mask = 0;
+    for (int i = 0; i < simd_width; ++i)
+    {
+        float tn = static_cast<float>(tmin);
+        float tf = static_cast<float>(tmax);
+        for (int a = 0; a < 3; ++a)
+        {
+            const float t0 = (boxes.min[a][i] - rd.origin_f[a]) * rd.inv_dir_f[a];
+            const float t1 = (boxes.max[a][i] - rd.origin_f[a]) * rd.inv_dir_f[a];
+            tn             = std::max(tn, std::min(t0, t1));
+            tf             = std::min(tf, std::max(t0, t1) * simd_float_robust_scale);
+        }
+        t_entry[i] = tn;
+        mask |= (tn <= tf ? 1u : 0u) << i;
+    }
+    return mask;
+#endif
+}
+
+/// @brief simd_width条相干光线（例如相邻像素的主光线），按结构数组存储
+struct alignas(32) ray_packet
+{
+    float origin[3][simd_width];
+    float inv_dir[3][simd_width];
+    float tmin[simd_width];
+    float tmax[simd_width];
+};
+
+/// @brief simd_width条光线同时与一个包围盒求交
+/// @return 与包围盒相交的光线的位掩码
+inline uint32_t intersect_ray_packet(const ray_packet& rays, const float* bounds_min, const float* bounds_max) noexcept
+{
+#if RT_SIMD_LEVEL >= 2
+    __m256 tn = _mm256_load_ps(rays.tmin);
+    __m256 tf = _mm256_load_ps(rays.tmax);
+    for (int a = 0; a < 3; ++a)
+    {
+        const __m256 o   = _mm256_load_ps(rays.origin[a]);
+        const __m256 inv = _mm256_load_ps(rays.inv_dir[a]);
+        const __m256 t0  = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(bounds_min[a]), o), inv);
+        const __m256 t1  = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(bounds_max[a]), o), inv);
+        tn               = _mm256_max_ps(tn, _mm256_min_ps(t0, t1));
+        tf               = _mm256_min_ps(tf, _mm256_mul_ps(_mm256_max_ps(t0, t1), _mm256_set1_ps(simd_float_robust_scale)));
+    }
+    return static_cast<uint32_t>(_mm256_movemask_ps(_mm256_cmp_ps(tn, tf, _CMP_LE_OQ)));
+#elif RT_SIMD_LEVEL >= 1
+    __m128 tn = _mm_load_ps(rays.tmin);
+    __m128 tf = _mm_load_ps(rays.tmax);
+    for (int a = 0; a < 3; ++a)
+    {
+        const __m128 o   = _mm_load_ps(rays.origin[a]);
+        const __m128 inv = _mm_load_ps(rays.inv_dir[a]);
+        const __m128 t0  = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(bounds_min[a]), o), inv);
+        const __m128 t1  = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(bounds_max[a]), o), inv);
+        tn               = _mm_max_ps(tn, _mm_min_ps(t0, t1));
+        tf               = _mm_min_ps(tf, _mm_mul_ps(_mm_max_ps(t0, t1), _mm_set1_ps(simd_float_robust_scale)));
+    }
+    return static_cast<uint32_t>(_mm_movemask_ps(_mm_cmple_ps(tn, tf)));
+#else
+    uint32_t mask = 0;
+    for (int i = 0; i < simd_width; ++i)
+    {
+        float tn = rays.tmin[i];
+        float tf = rays.tmax[i];
+        for (int a = 0; a < 3; ++a)
+        {
+            const float t0 = (bounds_min[a] - rays.origin[a][i]) * rays.inv_dir[a][i];
+            const float t1 = (bounds_max[a] - rays.origin[a][i]) * rays.inv_dir[a][i];
+            tn             = std::max(tn, std::min(t0, t1));
+            tf             = std::min(tf, std::max(t0, t1) * simd_float_robust_scale);
+        }
+        mask |= (tn <= tf ? 1u : 0u) << i;
+    }
+    return mask;
+#endif
+}
+
+/// @brief 4个球，按结构数组存储，与sphere::hit使用相同的标量类型，保证结果一致
+struct alignas(32) sphere_packet
+{
+    real center[3][4];
+    real radius[4];
+};
+
+/// @brief 单条光线同时与4个球求交，每个球取(t_min, t_max)内最近的交点，与sphere::hit的判断方式相同
+/// @param lanes 有效球的位掩码
+/// @param t 每个球的交点参数
+/// @return 有交点的球的位掩码
+inline uint32_t intersect_sphere_packet(const ray& r, const sphere_packet& spheres, uint32_t lanes, real t_min, real t_max, real* t) noexcept
+{
+    const vec3 o = r.origin();
+    const vec3 d = r.direction();
+    const real a = d.length_squared();
+
+#if RT_SIMD_LEVEL >= 1 && defined(RT_USE_FLOAT)
+    // float的4个球正好是一个SSE寄存器，AVX2时也使用同样的实现
+    const __m128 va = _mm_set1_ps(a);
+    const __m128 ocx = _mm_sub_ps(_mm_set1_ps(o.x()), _mm_load_ps(spheres.center[0]));
+    const __m128 ocy = _mm_sub_ps(_mm_set1_ps(o.y()), _mm_load_ps(spheres.center[1]));
+    const __m128 ocz = _mm_sub_ps(_mm_set1_ps(o.z()), _mm_load_ps(spheres.center[2]));
+    const __m128 radius = _mm_load_ps(spheres.radius);
+
+    const __m128 half_b
+        = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ocx, _mm_set1_ps(d.x())), _mm_mul_ps(ocy, _mm_set1_ps(d.y()))), _mm_mul_ps(ocz, _mm_set1_ps(d.z())));
+    const __m128 c = _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(ocx, ocx), _mm_mul_ps(ocy, ocy)), _mm_mul_ps(ocz, ocz)), _mm_mul_ps(radius, radius));
+    const __m128 discriminant = _mm_sub_ps(_mm_mul_ps(half_b, half_b), _mm_mul_ps(va, c));
+    const __m128 positive     = _mm_cmpgt_ps(discriminant, _mm_setzero_ps());
+    if ((static_cast<uint32_t>(_mm_movemask_ps(positive)) & lanes) == 0)
+    {
+        return 0;
+    }
+
+    const __m128 root   = _mm_sqrt_ps(_mm_max_ps(discriminant, _mm_setzero_ps()));
+    const __m128 near_t = _mm_div_ps(_mm_sub_ps(_mm_sub_ps(_mm_setzero_ps(), half_b), root), va);
+    const __m128 far_t  = _mm_div_ps(_mm_add_ps(_mm_sub_ps(_mm_setzero_ps(), half_b), root), va);
+
+    const __m128 lo      = _mm_set1_ps(t_min);
+    const __m128 hi      = _mm_set1_ps(t_max);
+    const __m128 near_ok = _mm_and_ps(_mm_cmplt_ps(near_t, hi), _mm_cmpgt_ps(near_t, lo));
+    const __m128 far_ok  = _mm_and_ps(_mm_cmplt_ps(far_t, hi), _mm_cmpgt_ps(far_t, lo));
+    const __m128 result  = _mm_or_ps(_mm_and_ps(near_ok, near_t), _mm_andnot_ps(near_ok, far_t));
+
+    _mm_storeu_ps(t, result);
+    return static_cast<uint32_t>(_mm_movemask_ps(_mm_and_ps(positive, _mm_or_ps(near_ok, far_ok)))) & lanes;
+#elif RT_SIMD_LEVEL >= 2
+    const __m256d va = _mm256_set1_pd(a);
+    const __m256d ocx = _mm256_sub_pd(_mm256_set1_pd(o.x()), _mm256_load_pd(spheres.center[0]));
+    const __m256d ocy = _mm256_sub_pd(_mm256_set1_pd(o.y()), _mm256_load_pd(spheres.center[1]));
+    const __m256d ocz = _mm256_sub_pd(_mm256_set1_pd(o.z()), _mm256_load_pd(spheres.center[2]));
+    const __m256d radius = _mm256_load_pd(spheres.radius);
+
+    const __m256d half_b = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(ocx, _mm256_set1_pd(d.x())), _mm256_mul_pd(ocy, _mm256_set1_pd(d.y()))),
+        _mm256_mul_pd(ocz, _mm256_set1_pd(d.z())));
+    const __m256d c = _mm256_sub_pd(_mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(ocx, ocx), _mm256_mul_pd(ocy, ocy)), _mm256_mul_pd(ocz, ocz)),
+        _mm256_mul_pd(radius, radius));
+    const __m256d discriminant = _mm256_sub_pd(_mm256_mul_pd(half_b, half_b), _mm256_mul_pd(va, c));
+    const __m256d positive     = _mm256_cmp_pd(discriminant, _mm256_setzero_pd(), _CMP_GT_OQ);
+    if ((static_cast<uint32_t>(_mm256_movemask_pd(positive)) & lanes) == 0)
+    {
+        // 大部分情况下光线与所有球都不相交，不需要开方和除法
+        return 0;
+    }
+
+    const __m256d root   = _mm256_sqrt_pd(_mm256_max_pd(discriminant, _mm256_setzero_pd()));
+    const __m256d near_t = _mm256_div_pd(_mm256_sub_pd(_mm256_sub_pd(_mm256_setzero_pd(), half_b), root), va);
+    const __m256d far_t  = _mm256_div_pd(_mm256_add_pd(_mm256_sub_pd(_mm256_setzero_pd(), half_b), root), va);
+
+    const __m256d lo       = _mm256_set1_pd(t_min);
+    const __m256d hi       = _mm256_set1_pd(t_max);
+    const __m256d near_ok  = _mm256_and_pd(_mm256_cmp_pd(near_t, hi, _CMP_LT_OQ), _mm256_cmp_pd(near_t, lo, _CMP_GT_OQ));
+    const __m256d far_ok   = _mm256_and_pd(_mm256_cmp_pd(far_t, hi, _CMP_LT_OQ), _mm256_cmp_pd(far_t, lo, _CMP_GT_OQ));
+    const __m256d result   = _mm256_blendv_pd(far_t, near_t, near_ok);
+    const __m256d hit_mask = _mm256_and_pd(positive, _mm256_or_pd(near_ok, far_ok));
+
+    _mm256_storeu_pd(t, result);
+    return static_cast<uint32_t>(_mm256_movemask_pd(hit_mask)) & lanes;
+#elif RT_SIMD_LEVEL >= 1
+    // 每次处理两个球，SSE2没有blendv，用与或运算代替
+    uint32_t mask = 0;
+    for (int i = 0; i < 4; i += 2)
+    {
+        if (((lanes >> i) & 3u) == 0)
+        {
+            continue;
+        }
+
+        const __m128d va  = _mm_set1_pd(a);
+        const __m128d ocx = _mm_sub_pd(_mm_set1_pd(o.x()), _mm_load_pd(spheres.center[0] + i));
+        const __m128d ocy = _mm_sub_pd(_mm_set1_pd(o.y()), _mm_load_pd(spheres.center[1] + i));
+        const __m128d ocz = _mm_sub_pd(_mm_set1_pd(o.z()), _mm_load_pd(spheres.center[2] + i));
+        const __m128d radius = _mm_load_pd(spheres.radius + i);
+
+        const __m128d half_b
+            = _mm_add_pd(_mm_add_pd(_mm_mul_pd(ocx, _mm_set1_pd(d.x())), _mm_mul_pd(ocy, _mm_set1_pd(d.y()))), _mm_mul_pd(ocz, _mm_set1_pd(d.z())));
+        const __m128d c = _mm_sub_pd(_mm_add_pd(_mm_add_pd(_mm_mul_pd(ocx, ocx), _mm_mul_pd(ocy, ocy)), _mm_mul_pd(ocz, ocz)), _mm_mul_pd(radius, radius));
+        const __m128d discriminant = _mm_sub_pd(_mm_mul_pd(half_b, half_b), _mm_mul_pd(va, c));
+        const __m128d positive     = _mm_cmpgt_pd(discriminant, _mm_setzero_pd());
+        if (((static_cast<uint32_t>(_mm_movemask_pd(positive)) << i) & lanes) == 0)
+        {
+            continue;
+        }
+
+        const __m128d root   = _mm_sqrt_pd(_mm_max_pd(discriminant, _mm_setzero_pd()));
+        const __m128d near_t = _mm_div_pd(_mm_sub_pd(_mm_sub_pd(_mm_setzero_pd(), half_b), root), va);
+        const __m128d far_t  = _mm_div_pd(_mm_add_pd(_mm_sub_pd(_mm_setzero_pd(), half_b), root), va);
+
+        const __m128d lo      = _mm_set1_pd(t_min);
+        const __m128d hi      = _mm_set1_pd(t_max);
+        const __m128d near_ok = _mm_and_pd(_mm_cmplt_pd(near_t, hi), _mm_cmpgt_pd(near_t, lo));
+        const __m128d far_ok  = _mm_and_pd(_mm_cmplt_pd(far_t, hi), _mm_cmpgt_pd(far_t, lo));
+        const __m128d result  = _mm_or_pd(_mm_and_pd(near_ok, near_t), _mm_andnot_pd(near_ok, far_t));
+
+        _mm_storeu_pd(t + i, result);
+        mask |= static_cast<uint32_t>(_mm_movemask_pd(_mm_and_pd(positive, _mm_or_pd(near_ok, far_ok)))) << i;
+    }
+    return mask & lanes;
+#else
+    uint32_t mask = 0;
+    for (int i = 0; i < 4; ++i)
+    {
+        const real ocx    = o.x() - spheres.center[0][i];
+        const real ocy    = o.y() - spheres.center[1][i];
+        const real ocz    = o.z() - spheres.center[2][i];
+        const real half_b = ocx * d.x() + ocy * d.y() + ocz * d.z();
+        const real c      = (ocx * ocx + ocy * ocy + ocz * ocz) - spheres.radius[i] * spheres.radius[i];
+
+        const real discriminant = half_b * half_b - a * c;
+        const real root         = std::sqrt(discriminant > 0 ? discriminant : real(0));
+        const real near_t       = (-half_b - root) / a;
+        const real far_t        = (-half_b + root) / a;
+
+        const bool near_ok = near_t < t_max && near_t > t_min;
+        const bool far_ok  = far_t < t_max && far_t > t_min;
+        t[i]               = near_ok ? near_t : far_t;
+        mask |= ((discriminant > 0 && (near_ok || far_ok)) ? 1u : 0u) << i;
+    }
+    return mask & lanes;
+#endif
+}
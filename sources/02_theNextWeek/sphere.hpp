@@ -3,20 +3,42 @@
 #include "hittable.hpp"
 #include "rtweekend.hpp"
 
+/// @brief 光线在(t_min, t_max)内是否与球相交，两个根的判断与sphere::hit相同
+inline bool hit_sphere(const ray& r, const vec3& center, real radius, real t_min, real t_max)
+{
+    vec3 oc           = r.origin() - center;
+    auto a            = r.direction().length_squared();
+    auto half_b       = dot(oc, r.direction());
+    auto c            = oc.length_squared() - radius * radius;
+    auto discriminant = half_b * half_b - a * c;
+
+    if (discriminant <= 0)
+    {
+        return false;
+    }
+
+    auto root = std::sqrt(discriminant);
+    auto near = (-half_b - root) / a;
+    auto far  = (-half_b + root) / a;
+    return (near < t_max && near > t_min) || (far < t_max && far > t_min);
+}
+
 class sphere : public hittable
 {
 public:
     sphere() noexcept = default;
 
-    sphere(vec3 cen, double r, shared_ptr<material> m)
+    sphere(vec3 cen, real r, uint32_t m)
         : center(cen)
         , radius(r)
-        , mat_ptr(m)
+        , material_id(m)
     {
     }
 
-    virtual bool hit(const ray& r, double t_min, double t_max, hit_record& rec) const override
+    virtual bool hit(const ray& r, real t_min, real t_max, hit_record& rec) const override
     {
+        stats::count_primitive_tests(1);
+
         vec3 oc           = r.origin() - center;
         auto a            = r.direction().length_squared();
         auto half_b       = dot(oc, r.direction());
@@ -25,7 +47,7 @@ public:
 
         if (discriminant > 0)
         {
-            auto root = sqrt(discriminant);
+            auto root = std::sqrt(discriminant);
             auto temp = (-half_b - root) / a;
             if (temp < t_max && temp > t_min)
             {
@@ -33,7 +55,7 @@ public:
                 rec.p               = r.at(rec.t);
                 vec3 outward_normal = (rec.p - center) / radius;
                 rec.set_face_normal(r, outward_normal);
-                rec.mat_ptr = mat_ptr;
+                rec.material_id = material_id;
                 return true;
             }
             temp = (-half_b + root) / a;
@@ -43,14 +65,20 @@ public:
                 rec.p               = r.at(rec.t);
                 vec3 outward_normal = (rec.p - center) / radius;
                 rec.set_face_normal(r, outward_normal);
-                rec.mat_ptr = mat_ptr;
+                rec.material_id = material_id;
                 return true;
             }
         }
         return false;
     }
 
-    virtual bool bounding_box(double t0, double t1, aabb& output_box) const override
+    virtual bool occluded(const ray& r, real t_min, real t_max) const override
+    {
+        stats::count_primitive_tests(1);
+        return hit_sphere(r, center, radius, t_min, t_max);
+    }
+
+    virtual bool bounding_box(real t0, real t1, aabb& output_box) const override
     {
         output_box = aabb(center - vec3(radius), center + vec3(radius));
         return true;
@@ -58,8 +86,8 @@ public:
 
 public:
     vec3 center {};
-    double radius { 0.0 };
-    shared_ptr<material> mat_ptr;
+    real radius { 0.0 };
+    uint32_t material_id { 0 };
 };
 
 class moving_sphere : public hittable
@@ -69,18 +97,20 @@ public:
     {
     }
 
-    moving_sphere(vec3 cen0, vec3 cen1, double t0, double t1, double r, shared_ptr<material> m)
+    moving_sphere(vec3 cen0, vec3 cen1, real t0, real t1, real r, uint32_t m)
         : center0(cen0)
         , center1(cen1)
         , time0(t0)
         , time1(t1)
         , radius(r)
-        , mat_ptr(m)
+        , material_id(m)
     {
     }
 
-    virtual bool hit(const ray& r, double t_min, double t_max, hit_record& rec) const
+    virtual bool hit(const ray& r, real t_min, real t_max, hit_record& rec) const
     {
+        stats::count_primitive_tests(1);
+
         vec3 oc     = r.origin() - center(r.time());
         auto a      = r.direction().length_squared();
         auto half_b = dot(oc, r.direction());
@@ -90,7 +120,7 @@ public:
 
         if (discriminant > 0)
         {
-            auto root = sqrt(discriminant);
+            auto root = std::sqrt(discriminant);
 
             auto temp = (-half_b - root) / a;
             if (temp < t_max && temp > t_min)
@@ -99,7 +129,7 @@ public:
                 rec.p               = r.at(rec.t);
                 vec3 outward_normal = (rec.p - center(r.time())) / radius;
                 rec.set_face_normal(r, outward_normal);
-                rec.mat_ptr = mat_ptr;
+                rec.material_id = material_id;
                 return true;
             }
 
@@ -110,14 +140,20 @@ public:
                 rec.p               = r.at(rec.t);
                 vec3 outward_normal = (rec.p - center(r.time())) / radius;
                 rec.set_face_normal(r, outward_normal);
-                rec.mat_ptr = mat_ptr;
+                rec.material_id = material_id;
                 return true;
             }
         }
         return false;
     }
 
-    virtual bool bounding_box(double t0, double t1, aabb& output_box) const override
+    virtual bool occluded(const ray& r, real t_min, real t_max) const override
+    {
+        stats::count_primitive_tests(1);
+        return hit_sphere(r, center(r.time()), radius, t_min, t_max);
+    }
+
+    virtual bool bounding_box(real t0, real t1, aabb& output_box) const override
     {
         aabb box0(center(t0) - vec3(radius), center(t0) + vec3(radius));
         aabb box1(center(t1) - vec3(radius), center(t1) + vec3(radius));
@@ -126,14 +162,14 @@ public:
         return true;
     }
 
-    vec3 center(double time) const
+    vec3 center(real time) const
     {
         return center0 + ((time - time0) / (time1 - time0)) * (center1 - center0);
     }
 
 private:
     vec3 center0, center1;
-    double time0, time1;
-    double radius;
-    shared_ptr<material> mat_ptr;
+    real time0, time1;
+    real radius;
+    uint32_t material_id;
 };
@@ -0,0 +1,742 @@
+#pragma once
+
+#include "flat_bvh.hpp"
+#include "hittable.hpp"
+#include "mapped_file.hpp"
+#include "simd.hpp"
+
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <span>
+#include <string>
+#include <system_error>
+#include <vector>
+
+/// @brief BVH缓存文件的文件头，后面是按64字节对齐的节点数组和球块数组，与sphere_soa内存中的布局相同
+/// 只能由相同的浮点类型、相同字节序的程序读取，文件头中记录了这些信息
+struct bvh_cache_header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t real_size;  // sizeof(real)
+    uint32_t node_size;  // sizeof(flat_bvh_node)或sizeof(motion_bvh_node)
+    uint32_t block_size; // sizeof(sphere_soa::sphere_block)
+    uint32_t motion;     // 1表示节点是motion_bvh_node
+    uint32_t reserved;
+    uint64_t key;        // sphere_soa::bvh_key，场景或构建参数改变时不同
+    uint64_t node_count;
+    uint64_t block_count;
+    uint64_t node_offset;  // 节点数组在文件中的偏移（字节）
+    uint64_t block_offset; // 球块数组在文件中的偏移（字节）
+    double time0;          // 运动模糊BVH的快门时间
+    double time1;
+};
+
+inline constexpr char bvh_cache_magic[8]  = { 'R', 'T', 'B', 'V', 'H', '\0', '\0', '\0' };
+inline constexpr uint32_t bvh_cache_version = 2;
+
+/// @brief 按结构数组（SoA）存储的球体集合，包括静止的球和运动的球
+/// 球心、半径、运动向量和材质下标分别存放在连续的数组中，没有逐个对象的堆分配，
+/// 内部用bvh_builder构建一棵BVH，每个叶子中的球每4个一组打包成连续的块，用SIMD内核求交，
+/// 只有在找到最终的最近交点后才读取材质下标；
+/// 有运动的球时构建运动模糊BVH（motion_bvh_node），节点包围盒按光线的时刻插值
+class sphere_soa : public hittable
+{
+public:
+    sphere_soa() noexcept = default;
+
+    // 遍历使用的视图指向对象自己的数组，不能复制
+    sphere_soa(const sphere_soa&)            = delete;
+    sphere_soa& operator=(const sphere_soa&) = delete;
+
+    /// @brief 添加一个静止的球
+    void add(const vec3& center, real radius, uint32_t material)
+    {
+        add(center, center, 0.0, 1.0, radius, material);
+    }
+
+    /// @brief 添加一个运动的球，t0时刻球心在center0，t1时刻在center1
+    void add(const vec3& center0, const vec3& center1, real t0, real t1, real radius, uint32_t material)
+    {
+        const vec3 motion = center1 - center0;
+        for (size_t a = 0; a < 3; ++a)
+        {
+            _center[a].push_back(center0[a]);
+            _motion[a].push_back(motion[a]);
+        }
+        _radius.push_back(radius);
+        _time0.push_back(t0);
+        _time_span.push_back(t1 - t0);
+        _material.push_back(material);
+        reset_bvh();
+    }
+
+    /// @brief 预先分配count个球的空间，批量添加时不再重新分配
+    void reserve(size_t count)
+    {
+        for (size_t a = 0; a < 3; ++a)
+        {
+            _center[a].reserve(count);
+            _motion[a].reserve(count);
+        }
+        _radius.reserve(count);
+        _time0.reserve(count);
+        _time_span.reserve(count);
+        _material.reserve(count);
+    }
+
+    size_t size() const noexcept
+    {
+        return _radius.size();
+    }
+
+    /// @brief 第i个球在time时刻的球心，与moving_sphere::center的计算方式相同
+    vec3 center(size_t i, real time) const noexcept
+    {
+        const real u = (time - _time0[i]) / _time_span[i];
+        return vec3(_center[0][i], _center[1][i], _center[2][i]) + u * vec3(_motion[0][i], _motion[1][i], _motion[2][i]);
+    }
+
+    /// @brief 第i个球的运动参数：time0时刻球心在center0，time1时刻在center1
+    void motion(size_t i, vec3& center0, vec3& center1, real& time0, real& time1) const noexcept
+    {
+        center0 = vec3(_center[0][i], _center[1][i], _center[2][i]);
+        center1 = center0 + vec3(_motion[0][i], _motion[1][i], _motion[2][i]);
+        time0   = _time0[i];
+        time1   = _time0[i] + _time_span[i];
+    }
+
+    bool moving(size_t i) const noexcept
+    {
+        return _motion[0][i] != 0 || _motion[1][i] != 0 || _motion[2][i] != 0;
+    }
+
+    real radius(size_t i) const noexcept
+    {
+        return _radius[i];
+    }
+
+    uint32_t material(size_t i) const noexcept
+    {
+        return _material[i];
+    }
+
+    /// @brief 构建BVH，添加完所有球之后、渲染之前调用一次
+    /// 没有运动的球时构建静态的BVH；否则按快门中间时刻的包围盒划分，
+    /// 再自底向上计算每个节点在快门打开和关闭时刻的包围盒，得到运动模糊BVH
+    /// @param time0 快门打开时间，光线的时刻必须在快门时间内
+    /// @param time1 快门关闭时间
+    void build(real time0, real time1, const bvh_build_options& options = {})
+    {
+        bool has_motion = false;
+        for (size_t i = 0; i < size() && !has_motion; ++i)
+        {
+            has_motion = moving(i);
+        }
+        has_motion = has_motion && time1 > time0;
+
+        std::vector<aabb> boxes(size());
+        for (size_t i = 0; i < size(); ++i)
+        {
+            boxes[i] = has_motion ? sphere_box(i, 0.5 * (time0 + time1)) : sphere_box(i, time0);
+        }
+
+        auto result = bvh_builder(options).build(boxes);
+        _nodes      = std::move(result.nodes);
+
+        _motion_nodes.clear();
+        if (has_motion)
+        {
+            _motion_nodes = refit_motion(_nodes, result.primitive_indices, time0, time1);
+        }
+
+        // 每个叶子中的球按4个一组打包成连续的块，叶子的offset改为第一个块的下标
+        _blocks.clear();
+        for (auto& node : _nodes)
+        {
+            if (!node.is_leaf())
+            {
+                continue;
+            }
+
+            const uint32_t first = node.offset;
+            node.offset          = static_cast<uint32_t>(_blocks.size());
+            for (uint32_t k = 0; k < node.count; k += 4)
+            {
+                sphere_block block {};
+                block.count = std::min<uint32_t>(4, node.count - k);
+                for (uint32_t lane = 0; lane < 4; ++lane)
+                {
+                    // 空位复制块中的第一个球，结果会被掩码丢弃
+                    const size_t i = result.primitive_indices[first + k + (lane < block.count ? lane : 0)];
+                    for (size_t a = 0; a < 3; ++a)
+                    {
+                        block.spheres.center[a][lane] = _center[a][i];
+                        block.motion[a][lane]         = _motion[a][i];
+                        block.moving |= _motion[a][i] != 0.0;
+                    }
+                    block.spheres.radius[lane] = _radius[i];
+                    block.time0[lane]          = _time0[i];
+                    block.time_span[lane]      = _time_span[i];
+                    block.material[lane]       = _material[i];
+                }
+                _blocks.push_back(block);
+            }
+        }
+
+        if (has_motion)
+        {
+            for (size_t n = 0; n < _nodes.size(); ++n)
+            {
+                _motion_nodes[n].offset = _nodes[n].offset;
+            }
+            _nodes.clear();
+        }
+
+        _cache.close();
+        set_views(_nodes, _motion_nodes, _blocks, time0, time1);
+    }
+
+    /// @brief BVH缓存的键：所有球的数据、快门时间和影响构建结果的参数的哈希，
+    /// 只有这些都相同时构建出的BVH才相同，材质参数和相机不影响BVH
+    uint64_t bvh_key(real time0, real time1, const bvh_build_options& options) const noexcept
+    {
+        uint64_t h = hash_seed(bvh_cache_version, sizeof(real));
+
+        const auto mix = [&](const auto& values) {
+            for (const auto v : values)
+            {
+                if constexpr (sizeof(v) == 8)
+                {
+                    h = hash_seed(h, std::bit_cast<uint64_t>(v));
+                }
+                else
+                {
+                    h = hash_seed(h, std::bit_cast<uint32_t>(v));
+                }
+            }
+        };
+
+        h = hash_seed(h, size());
+        for (size_t a = 0; a < 3; ++a)
+        {
+            mix(_center[a]);
+            mix(_motion[a]);
+        }
+        mix(_radius);
+        mix(_time0);
+        mix(_time_span);
+        mix(_material);
+
+        const real times[] = { time0, time1 };
+        const double costs[] = { options.traversal_cost, options.intersection_cost };
+        const uint64_t sizes[] = { static_cast<uint64_t>(options.split_method), options.bin_count, options.max_leaf_size };
+        mix(times);
+        mix(costs);
+        mix(sizes);
+        return h;
+    }
+
+    /// @brief 把构建好的BVH写入缓存文件，先写临时文件再改名，并发的进程不会读到写了一半的文件
+    bool save_bvh(const std::string& path, uint64_t key) const
+    {
+        if (_node_view.empty() && _motion_view.empty())
+        {
+            return false;
+        }
+
+        const bool motion           = !_motion_view.empty();
+        const size_t node_count     = motion ? _motion_view.size() : _node_view.size();
+        const size_t node_bytes     = motion ? _motion_view.size_bytes() : _node_view.size_bytes();
+        const char* const node_data = motion ? reinterpret_cast<const char*>(_motion_view.data()) : reinterpret_cast<const char*>(_node_view.data());
+
+        bvh_cache_header header {};
+        std::memcpy(header.magic, bvh_cache_magic, sizeof(header.magic));
+        header.version      = bvh_cache_version;
+        header.real_size    = sizeof(real);
+        header.node_size    = motion ? sizeof(motion_bvh_node) : sizeof(flat_bvh_node);
+        header.block_size   = sizeof(sphere_block);
+        header.motion       = motion;
+        header.key          = key;
+        header.node_count   = node_count;
+        header.block_count  = _block_view.size();
+        header.node_offset  = align_cache_offset(sizeof(header));
+        header.block_offset = align_cache_offset(header.node_offset + node_bytes);
+        header.time0        = _time_open;
+        header.time1        = _time_open + (_inv_shutter > 0 ? 1.0 / _inv_shutter : 0.0);
+
+        // 每个写入者使用不同的临时文件，多个进程同时缓存同一个key时不会写到同一个文件里
+        const std::string temp = path + "." + std::to_string(unique_suffix()) + ".tmp";
+        bool written           = false;
+        {
+            std::ofstream file(temp, std::ios::binary);
+            const char padding[cache_alignment] {};
+            const auto pad_to = [&](uint64_t offset) { file.write(padding, static_cast<std::streamsize>(offset - static_cast<uint64_t>(file.tellp()))); };
+
+            file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            pad_to(header.node_offset);
+            file.write(node_data, static_cast<std::streamsize>(node_bytes));
+            pad_to(header.block_offset);
+            file.write(reinterpret_cast<const char*>(_block_view.data()), static_cast<std::streamsize>(_block_view.size_bytes()));
+            file.close();
+            written = !file.fail();
+        }
+
+        std::error_code ec;
+        if (written)
+        {
+            std::filesystem::rename(temp, path, ec);
+        }
+        if (!written || ec)
+        {
+            std::error_code ignored;
+            std::filesystem::remove(temp, ignored);
+            return false;
+        }
+        return true;
+    }
+
+    /// @brief 映射缓存文件，直接在映射的内存上遍历，不复制节点
+    /// 文件头与当前程序和key不符，或者节点结构不合法（下标越界、深度超过遍历栈）时返回false，BVH保持不变
+    bool load_bvh(const std::string& path, uint64_t key)
+    {
+        mapped_file file;
+        if (!file.open(path) || file.size() < sizeof(bvh_cache_header))
+        {
+            return false;
+        }
+
+        bvh_cache_header header;
+        std::memcpy(&header, file.data(), sizeof(header));
+        const size_t node_size = header.motion ? sizeof(motion_bvh_node) : sizeof(flat_bvh_node);
+        if (std::memcmp(header.magic, bvh_cache_magic, sizeof(header.magic)) != 0 || header.version != bvh_cache_version || header.real_size != sizeof(real)
+            || header.motion > 1 || header.node_size != node_size || header.block_size != sizeof(sphere_block) || header.key != key)
+        {
+            return false;
+        }
+
+        const auto fits = [&](uint64_t offset, uint64_t count, uint64_t stride) {
+            return offset <= file.size() && count <= (file.size() - offset) / stride && offset % cache_alignment == 0;
+        };
+        if (header.node_count == 0 || !fits(header.node_offset, header.node_count, node_size)
+            || !fits(header.block_offset, header.block_count, sizeof(sphere_block)))
+        {
+            return false;
+        }
+
+        std::span<const flat_bvh_node> nodes;
+        std::span<const motion_bvh_node> motion_nodes;
+        if (header.motion)
+        {
+            motion_nodes = { reinterpret_cast<const motion_bvh_node*>(file.data() + header.node_offset), header.node_count };
+        }
+        else
+        {
+            nodes = { reinterpret_cast<const flat_bvh_node*>(file.data() + header.node_offset), header.node_count };
+        }
+        const std::span<const sphere_block> blocks(reinterpret_cast<const sphere_block*>(file.data() + header.block_offset), header.block_count);
+        if (!(header.motion ? valid_bvh(motion_nodes, blocks) : valid_bvh(nodes, blocks)))
+        {
+            return false;
+        }
+
+        _nodes.clear();
+        _motion_nodes.clear();
+        _blocks.clear();
+        _cache = std::move(file);
+        set_views(nodes, motion_nodes, blocks, header.time0, header.time1);
+        return true;
+    }
+
+    virtual bool hit(const ray& r, real t_min, real t_max, hit_record& rec) const override
+    {
+        sphere_hit best;
+        real best_t = t_max;
+
+        const auto leaf_hit = [&](const auto& leaf, real& closest) {
+            const bool found = intersect_leaf(r, leaf.offset, leaf.count, t_min, closest, best);
+            best_t           = closest;
+            return found;
+        };
+
+        bool hit_anything = false;
+        if (_motion_view.empty())
+        {
+            hit_anything = traverse_bvh(_node_view, r, t_min, t_max, leaf_hit);
+        }
+        else
+        {
+            const double u = std::clamp((r.time() - _time_open) * _inv_shutter, 0.0, 1.0);
+            hit_anything   = traverse_bvh(_motion_view, r, t_min, t_max, u, leaf_hit);
+        }
+
+        if (!hit_anything)
+        {
+            return false;
+        }
+
+        finish_hit(r, best_t, best, rec);
+        return true;
+    }
+
+    virtual bool occluded(const ray& r, real t_min, real t_max) const override
+    {
+        const auto leaf_test = [&](const auto& leaf) { return occluded_leaf(r, leaf.offset, leaf.count, t_min, t_max); };
+
+        if (_motion_view.empty())
+        {
+            return traverse_bvh_any(_node_view, r, t_min, t_max, leaf_test);
+        }
+        const double u = std::clamp((r.time() - _time_open) * _inv_shutter, 0.0, 1.0);
+        return traverse_bvh_any(_motion_view, r, t_min, t_max, u, leaf_test);
+    }
+
+    /// @brief 一块主光线与所有球求交，见traverse_bvh_block，每条光线的结果与hit相同
+    /// @param rec 长度为ray_block::size，只写入找到交点的光线
+    /// @return 找到交点的光线，第k位对应block中的第k条光线
+    uint64_t hit_block(const ray_block& block, real t_min, real t_max, hit_record* rec) const
+    {
+        ray_block_traversal traversal(block, t_min, t_max, _time_open, _inv_shutter);
+
+        real closest[ray_block::size];
+        sphere_hit best[ray_block::size];
+        std::fill(std::begin(closest), std::end(closest), t_max);
+
+        const auto leaf_hit = [&](const auto& leaf, uint64_t mask) {
+            uint64_t found = 0;
+            for (; mask != 0; mask &= mask - 1)
+            {
+                const int k = std::countr_zero(mask);
+                found |= uint64_t(intersect_leaf(block.get(k), leaf.offset, leaf.count, t_min, closest[k], best[k])) << k;
+            }
+            return found;
+        };
+
+        const uint64_t hits = _motion_view.empty() ? traverse_bvh_block(_node_view, traversal, block.active, t_min, closest, leaf_hit)
+                                                   : traverse_bvh_block(_motion_view, traversal, block.active, t_min, closest, leaf_hit);
+
+        for (uint64_t mask = hits; mask != 0; mask &= mask - 1)
+        {
+            const int k = std::countr_zero(mask);
+            finish_hit(block.get(k), closest[k], best[k], rec[k]);
+        }
+        return hits;
+    }
+
+    virtual bool bounding_box(real t0, real t1, aabb& output_box) const override
+    {
+        if (!_motion_view.empty())
+        {
+            output_box = surrounding_box(node_box(_motion_view[0], 0.0), node_box(_motion_view[0], 1.0));
+            return true;
+        }
+        if (_node_view.empty())
+        {
+            return false;
+        }
+
+        output_box = node_box(_node_view[0]);
+        return true;
+    }
+
+    /// @brief 静态BVH的节点，由build构建或者由load_bvh映射，构建的是运动模糊BVH时为空
+    std::span<const flat_bvh_node> nodes() const noexcept
+    {
+        return _node_view;
+    }
+
+    /// @brief 运动模糊BVH的节点，没有运动的球时为空
+    std::span<const motion_bvh_node> motion_nodes() const noexcept
+    {
+        return _motion_view;
+    }
+
+    size_t node_count() const noexcept
+    {
+        return _motion_view.empty() ? _node_view.size() : _motion_view.size();
+    }
+
+    /// @brief 整棵树的SAH代价，见bvh_sah_cost
+    double sah_cost(const bvh_build_options& options = {}) const noexcept
+    {
+        return _motion_view.empty() ? bvh_sah_cost(_node_view, options) : bvh_sah_cost(_motion_view, options);
+    }
+
+    /// @brief BVH是否来自映射的缓存文件
+    bool bvh_from_cache() const noexcept
+    {
+        return _cache.data() != nullptr;
+    }
+
+private:
+    /// @brief 删除BVH，添加球之后需要重新构建
+    void reset_bvh() noexcept
+    {
+        _nodes.clear();
+        _motion_nodes.clear();
+        _blocks.clear();
+        _cache.close();
+        set_views({}, {}, {}, 0.0, 0.0);
+    }
+
+    /// @brief 第i个球在time时刻的包围盒
+    aabb sphere_box(size_t i, real time) const noexcept
+    {
+        const vec3 r(std::abs(_radius[i]));
+        const vec3 c = center(i, time);
+        return aabb(c - r, c + r);
+    }
+
+    /// @brief 计算每个节点在快门打开和关闭时刻的包围盒
+    /// 球心线性运动，快门时间内任意时刻的包围盒都在两个时刻包围盒的线性插值之内；
+    /// 孩子的下标总是大于父节点，逆序遍历时孩子先于父节点完成
+    /// @param primitives bvh_builder输出的primitive_indices，叶子的offset是其中的下标
+    std::vector<motion_bvh_node> refit_motion(const std::vector<flat_bvh_node>& nodes, const std::vector<uint32_t>& primitives, real time0, real time1) const
+    {
+        std::vector<motion_bvh_node> motion_nodes(nodes.size());
+        std::vector<aabb> box0(nodes.size()), box1(nodes.size());
+        for (size_t n = nodes.size(); n-- > 0;)
+        {
+            const auto& node = nodes[n];
+            if (node.is_leaf())
+            {
+                const uint32_t first = primitives[node.offset];
+                box0[n]              = sphere_box(first, time0);
+                box1[n]              = sphere_box(first, time1);
+                for (uint32_t k = 1; k < node.count; ++k)
+                {
+                    box0[n] = surrounding_box(box0[n], sphere_box(primitives[node.offset + k], time0));
+                    box1[n] = surrounding_box(box1[n], sphere_box(primitives[node.offset + k], time1));
+                }
+            }
+            else
+            {
+                box0[n] = surrounding_box(box0[n + 1], box0[node.offset]);
+                box1[n] = surrounding_box(box1[n + 1], box1[node.offset]);
+            }
+
+            set_node_bounds(motion_nodes[n], box0[n], box1[n]);
+            motion_nodes[n].offset = node.offset;
+            motion_nodes[n].count  = node.count;
+            motion_nodes[n].axis   = node.axis;
+        }
+        return motion_nodes;
+    }
+
+    /// @brief 临时文件名的后缀：进程内的计数器加上随机设备、时钟和计数器地址（不同进程一般不同）的哈希
+    static uint64_t unique_suffix()
+    {
+        static std::atomic<uint64_t> counter { 0 };
+        static const uint64_t process = hash_seed(std::random_device {}() ^ reinterpret_cast<uintptr_t>(&counter),
+            static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count()));
+        return hash_seed(process, counter.fetch_add(1, std::memory_order_relaxed));
+    }
+
+    /// @brief 缓存文件中数组的对齐，不小于sphere_block的对齐
+    static constexpr uint64_t cache_alignment = 64;
+
+    static constexpr uint64_t align_cache_offset(uint64_t offset) noexcept
+    {
+        return (offset + cache_alignment - 1) / cache_alignment * cache_alignment;
+    }
+
+    /// @brief 叶子中的4个球，求交时直接作为sphere_packet传给SIMD内核
+    struct alignas(32) sphere_block
+    {
+        sphere_packet spheres; // time0时刻的球心和半径
+        real motion[3][4];
+        real time0[4];
+        real time_span[4];
+        uint32_t material[4];
+        uint32_t count; // 有效的球数
+        bool moving;    // 块中是否有运动的球
+
+        /// @brief time时刻的球心，与moving_sphere::center的计算方式相同
+        void centers_at(real time, sphere_packet& out) const noexcept
+        {
+            // 构建时空位复制了块中的第一个球，4个通道都按块中的数据计算，每个通道都有确定的值
+            for (uint32_t k = 0; k < 4; ++k)
+            {
+                const real u = (time - time0[k]) / time_span[k];
+                for (int a = 0; a < 3; ++a)
+                {
+                    out.center[a][k] = spheres.center[a][k] + u * motion[a][k];
+                }
+                out.radius[k] = spheres.radius[k];
+            }
+        }
+    };
+
+    /// @brief 检查从文件读取的节点：孩子的下标总是大于父节点、不越界，叶子引用的球块不越界，深度不超过遍历栈，
+    /// 每个球块有1到4个球，并且与叶子的球数一致（前面的块是满的，最后一块是剩下的球）
+    template <typename Node>
+    static bool valid_bvh(std::span<const Node> nodes, std::span<const sphere_block> blocks)
+    {
+        for (const auto& block : blocks)
+        {
+            if (block.count == 0 || block.count > 4)
+            {
+                return false;
+            }
+        }
+
+        const size_t block_count = blocks.size();
+        std::vector<uint8_t> depth(nodes.size(), 0);
+        for (size_t i = 0; i < nodes.size(); ++i)
+        {
+            const auto& node = nodes[i];
+            if (depth[i] >= bvh_max_depth)
+            {
+                return false;
+            }
+
+            if (node.is_leaf())
+            {
+                const uint64_t leaf_blocks = (node.count + uint64_t(3)) / 4;
+                if (node.offset + leaf_blocks > block_count)
+                {
+                    return false;
+                }
+                for (uint64_t k = 0; k < leaf_blocks; ++k)
+                {
+                    if (blocks[node.offset + k].count != std::min<uint64_t>(4, node.count - 4 * k))
+                    {
+                        return false;
+                    }
+                }
+                continue;
+            }
+
+            if (node.axis > 2 || i + 1 >= nodes.size() || node.offset <= i + 1 || node.offset >= nodes.size())
+            {
+                return false;
+            }
+            depth[i + 1]       = std::max<uint8_t>(depth[i + 1], depth[i] + 1);
+            depth[node.offset] = std::max<uint8_t>(depth[node.offset], depth[i] + 1);
+        }
+        return true;
+    }
+
+    /// @brief 目前最近的交点所在的球
+    struct sphere_hit
+    {
+        const sphere_block* block { nullptr };
+        int lane { 0 };
+    };
+
+    /// @brief 光线与一个叶子中的球求交，找到比closest更近的交点时更新closest和best
+    /// @param offset 叶子的第一个球块
+    /// @param count 叶子中的球数
+    bool intersect_leaf(const ray& r, uint32_t offset, uint32_t count, real t_min, real& closest, sphere_hit& best) const noexcept
+    {
+        bool found       = false;
+        const real s     = r.time();
+        const auto first = _block_view.data() + offset;
+        const auto last  = first + (count + 3) / 4;
+        for (auto block = first; block != last; ++block)
+        {
+            // 静止的球直接使用块中的数据，运动的球先计算光线时刻的球心
+            sphere_packet moved;
+            const sphere_packet* packet = &block->spheres;
+            if (block->moving)
+            {
+                block->centers_at(s, moved);
+                packet = &moved;
+            }
+
+            stats::count_primitive_tests(block->count);
+
+            real t[4];
+            uint32_t mask = intersect_sphere_packet(r, *packet, (1u << block->count) - 1, t_min, closest, t);
+            while (mask != 0)
+            {
+                const int k = std::countr_zero(mask);
+                mask &= mask - 1;
+                if (t[k] < closest)
+                {
+                    closest    = t[k];
+                    best.block = block;
+                    best.lane  = k;
+                    found      = true;
+                }
+            }
+        }
+        return found;
+    }
+
+    /// @brief 光线在(t_min, t_max)内是否与叶子中的任何一个球相交
+    bool occluded_leaf(const ray& r, uint32_t offset, uint32_t count, real t_min, real t_max) const noexcept
+    {
+        const auto first = _block_view.data() + offset;
+        const auto last  = first + (count + 3) / 4;
+        for (auto block = first; block != last; ++block)
+        {
+            sphere_packet moved;
+            const sphere_packet* packet = &block->spheres;
+            if (block->moving)
+            {
+                block->centers_at(r.time(), moved);
+                packet = &moved;
+            }
+
+            stats::count_primitive_tests(block->count);
+
+            real t[4];
+            if (intersect_sphere_packet(r, *packet, (1u << block->count) - 1, t_min, t_max, t) != 0)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /// @brief 只为最终的最近交点计算法线和材质
+    void finish_hit(const ray& r, real t, const sphere_hit& best, hit_record& rec) const noexcept
+    {
+        sphere_packet centers;
+        best.block->centers_at(r.time(), centers);
+        const vec3 center(centers.center[0][best.lane], centers.center[1][best.lane], centers.center[2][best.lane]);
+
+        rec.t               = t;
+        rec.p               = r.at(rec.t);
+        vec3 outward_normal = (rec.p - center) / best.block->spheres.radius[best.lane];
+        rec.set_face_normal(r, outward_normal);
+        rec.material_id = best.block->material[best.lane];
+    }
+
+    void set_views(std::span<const flat_bvh_node> nodes, std::span<const motion_bvh_node> motion_nodes, std::span<const sphere_block> blocks, double time0, double time1) noexcept
+    {
+        _node_view   = nodes;
+        _motion_view = motion_nodes;
+        _block_view  = blocks;
+        _time_open   = time0;
+        _inv_shutter = time1 > time0 ? 1.0 / (time1 - time0) : 0.0;
+    }
+
+private:
+    std::vector<real> _center[3]; // time0时刻的球心
+    std::vector<real> _motion[3]; // 从time0到time1球心的位移，静止的球为0
+    std::vector<real> _radius;
+    std::vector<real> _time0;
+    std::vector<real> _time_span;
+    std::vector<uint32_t> _material; // material_table中的下标
+
+    std::vector<flat_bvh_node> _nodes;          // 叶子的offset是_blocks中的下标，count是球数
+    std::vector<motion_bvh_node> _motion_nodes; // 有运动的球时代替_nodes
+    std::vector<sphere_block> _blocks;
+
+    // 遍历使用的节点和球块，指向_nodes、_motion_nodes、_blocks或者映射的缓存文件，
+    // _node_view和_motion_view中只有一个不为空
+    mapped_file _cache;
+    std::span<const flat_bvh_node> _node_view;
+    std::span<const motion_bvh_node> _motion_view;
+    std::span<const sphere_block> _block_view;
+    double _time_open { 0.0 };   // 快门打开时间
+    double _inv_shutter { 0.0 }; // 1 / 快门时长
+};
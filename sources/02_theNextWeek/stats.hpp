@@ -0,0 +1,275 @@
+#pragma once
+
+#include "framebuffer.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+/// @brief 路径结束的原因
+enum class path_end
+{
+    escaped,     // 没有击中任何物体，取背景色
+    absorbed,    // 材质没有散射光线
+    depth_limit, // 达到最大弹射次数
+    roulette,    // 被俄罗斯轮盘赌终止，见path_color
+};
+
+/// @brief 遍历和着色的计数
+struct render_stats
+{
+    /// @brief 按弹射次数统计光线数，超过的计入最后一项
+    static constexpr size_t max_tracked_depth = 64;
+
+    std::array<uint64_t, max_tracked_depth> rays_by_depth {}; // 积分器追踪的光线（最近交点查询）
+    uint64_t hits { 0 };
+    uint64_t misses { 0 };
+    uint64_t node_visits { 0 };     // 访问的BVH节点
+    uint64_t box_tests { 0 };       // 光线与包围盒求交的次数
+    uint64_t primitive_tests { 0 }; // 光线与图元求交的次数，SIMD内核中每个有效的通道算一次
+    std::array<uint64_t, 4> path_ends {}; // 按path_end统计结束的路径数
+
+    uint64_t rays() const noexcept
+    {
+        return hits + misses;
+    }
+
+    /// @brief 遍历代价，用于热力图
+    uint64_t traversal_cost() const noexcept
+    {
+        return node_visits + primitive_tests;
+    }
+
+    void merge(const render_stats& other) noexcept
+    {
+        for (size_t d = 0; d < max_tracked_depth; ++d)
+        {
+            rays_by_depth[d] += other.rays_by_depth[d];
+        }
+        hits += other.hits;
+        misses += other.misses;
+        node_visits += other.node_visits;
+        box_tests += other.box_tests;
+        primitive_tests += other.primitive_tests;
+        for (size_t k = 0; k < path_ends.size(); ++k)
+        {
+            path_ends[k] += other.path_ends[k];
+        }
+    }
+
+    void print(std::ostream& out) const
+    {
+        const auto per_ray = [&](uint64_t n) { return rays() > 0 ? double(n) / rays() : 0.0; };
+        const auto percent = [&](uint64_t n, uint64_t total) { return total > 0 ? 100.0 * n / total : 0.0; };
+
+        const uint64_t paths = path_ends[0] + path_ends[1] + path_ends[2] + path_ends[3];
+        out << "Rays: " << rays() << " (hit " << percent(hits, rays()) << "%, miss " << percent(misses, rays()) << "%)\n"
+            << "Node visits per ray: " << per_ray(node_visits) << '\n'
+            << "Box tests per ray: " << per_ray(box_tests) << '\n'
+            << "Primitive tests per ray: " << per_ray(primitive_tests) << '\n'
+            << "Path ends: escaped " << percent(path_ends[0], paths) << "%, absorbed " << percent(path_ends[1], paths) << "%, depth limit "
+            << percent(path_ends[2], paths) << "%, roulette " << percent(path_ends[3], paths) << "%\n"
+            << "Rays by depth:";
+        for (size_t d = 0; d < max_tracked_depth; ++d)
+        {
+            if (rays_by_depth[d] != 0)
+            {
+                out << ' ' << d << (d + 1 == max_tracked_depth ? "+:" : ":") << rays_by_depth[d];
+            }
+        }
+        out << '\n';
+    }
+};
+
+/// @brief 热点路径上的统计
+/// 定义RT_ENABLE_STATS（CMake选项）时计数，否则所有函数都是空的，编译后没有任何开销。
+/// 每个线程只写自己的计数器，不需要原子操作，for_each_tile在每个分块结束时把线程的计数合并到整帧的统计中
+class stats
+{
+public:
+#if defined(RT_ENABLE_STATS)
+    static constexpr bool enabled = true;
+#else
+    static constexpr bool enabled = false;
+#endif
+
+    /// @brief 记录当前弹射次数，ray_color每进入一层递归加一
+    class bounce_scope
+    {
+    public:
+        bounce_scope() noexcept
+        {
+            if constexpr (enabled)
+            {
+                _bounce = local().bounce++;
+            }
+        }
+
+        ~bounce_scope()
+        {
+            if constexpr (enabled)
+            {
+                --local().bounce;
+            }
+        }
+
+        bounce_scope(const bounce_scope&)            = delete;
+        bounce_scope& operator=(const bounce_scope&) = delete;
+
+        int bounce() const noexcept
+        {
+            return _bounce;
+        }
+
+    private:
+        int _bounce { 0 };
+    };
+
+    static void count_node_visit() noexcept
+    {
+        if constexpr (enabled)
+        {
+            ++local().counters.node_visits;
+        }
+    }
+
+    static void count_box_test() noexcept
+    {
+        if constexpr (enabled)
+        {
+            ++local().counters.box_tests;
+        }
+    }
+
+    static void count_primitive_tests(uint32_t n) noexcept
+    {
+        if constexpr (enabled)
+        {
+            local().counters.primitive_tests += n;
+        }
+    }
+
+    /// @brief 积分器追踪了一条光线
+    /// @param bounce 弹射次数，主光线为0
+    static void count_ray(int bounce, bool hit) noexcept
+    {
+        if constexpr (enabled)
+        {
+            auto& counters = local().counters;
+            ++counters.rays_by_depth[std::min<size_t>(static_cast<size_t>(bounce), render_stats::max_tracked_depth - 1)];
+            ++(hit ? counters.hits : counters.misses);
+        }
+    }
+
+    static void count_path_end(path_end reason, uint64_t n = 1) noexcept
+    {
+        if constexpr (enabled)
+        {
+            local().counters.path_ends[static_cast<size_t>(reason)] += n;
+        }
+    }
+
+    /// @brief 当前线程到目前为止的遍历代价，渲染器取一个像素前后的差作为这个像素的代价
+    static uint64_t thread_cost() noexcept
+    {
+        if constexpr (enabled)
+        {
+            return local().counters.traversal_cost();
+        }
+        return 0;
+    }
+
+    /// @brief 累加像素的遍历代价，一个像素同一时刻只被一个线程渲染，不需要加锁
+    static void add_pixel_cost(size_t index, uint64_t cost) noexcept
+    {
+        if constexpr (enabled)
+        {
+            if (index < _pixel_cost.size())
+            {
+                _pixel_cost[index] += cost;
+            }
+        }
+    }
+
+    /// @brief 开始新的一帧，清空整帧的统计和热力图，在渲染之前调用
+    static void begin_frame(int width, int height)
+    {
+        if constexpr (enabled)
+        {
+            std::lock_guard lock(_mutex);
+            _frame  = {};
+            _width  = width;
+            _height = height;
+            _pixel_cost.assign(static_cast<size_t>(width) * height, 0);
+            local().counters = {};
+        }
+    }
+
+    /// @brief 把当前线程的计数合并到整帧的统计中并清零
+    static void flush_thread()
+    {
+        if constexpr (enabled)
+        {
+            auto& counters = local().counters;
+            std::lock_guard lock(_mutex);
+            _frame.merge(counters);
+            counters = {};
+        }
+    }
+
+    /// @brief 整帧的统计，在渲染结束后调用
+    static render_stats frame()
+    {
+        flush_thread();
+        std::lock_guard lock(_mutex);
+        return _frame;
+    }
+
+    /// @brief 每个像素遍历代价的热力图，按最大代价归一化后用蓝-青-绿-黄-红的色带着色
+    static framebuffer heatmap()
+    {
+        framebuffer image(_width, _height);
+        if (_pixel_cost.empty())
+        {
+            return image;
+        }
+
+        const double max_cost = static_cast<double>(std::max<uint64_t>(1, *std::max_element(_pixel_cost.begin(), _pixel_cost.end())));
+        const vec3 ramp[] = { vec3(0, 0, 1), vec3(0, 1, 1), vec3(0, 1, 0), vec3(1, 1, 0), vec3(1, 0, 0) };
+        for (int y = 0; y < _height; ++y)
+        {
+            for (int x = 0; x < _width; ++x)
+            {
+                const double v = _pixel_cost[static_cast<size_t>(y) * _width + x] / max_cost * 4;
+                const int k    = std::min(3, static_cast<int>(v));
+                const vec3 c   = ramp[k] + (v - k) * (ramp[k + 1] - ramp[k]);
+
+                // 写出时做gamma 2校正，这里先平方，输出的颜色就是色带上的颜色
+                image.add(x, y, c * c, 1);
+            }
+        }
+        return image;
+    }
+
+private:
+    struct thread_state
+    {
+        render_stats counters;
+        int bounce { 0 };
+    };
+
+    static thread_state& local() noexcept
+    {
+        thread_local thread_state state;
+        return state;
+    }
+
+    static inline std::mutex _mutex;
+    static inline render_stats _frame;
+    static inline std::vector<uint64_t> _pixel_cost; // 整幅图像每个像素的遍历代价
+    static inline int _width { 0 };
+    static inline int _height { 0 };
+};
@@ -0,0 +1,168 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/// @brief 带任务窃取（work stealing）的线程池
+/// 每个工作线程有自己的任务队列，从自己队列的尾部取任务，
+/// 自己的队列为空时从其他线程队列的头部窃取任务，耗时长的任务不会拖住整个线程池
+class thread_pool
+{
+public:
+    using task = std::function<void()>;
+
+    /// @brief
+    /// @param thread_count 工作线程数量，为0时使用硬件线程数
+    explicit thread_pool(size_t thread_count = 0)
+    {
+        if (thread_count == 0)
+        {
+            thread_count = std::max(1u, std::thread::hardware_concurrency());
+        }
+
+        _queues = std::vector<work_queue>(thread_count);
+        _workers.reserve(thread_count);
+        for (size_t i = 0; i < thread_count; ++i)
+        {
+            _workers.emplace_back([this, i] { worker_loop(i); });
+        }
+    }
+
+    thread_pool(const thread_pool&)            = delete;
+    thread_pool& operator=(const thread_pool&) = delete;
+
+    ~thread_pool() noexcept
+    {
+        {
+            std::lock_guard lock(_mutex);
+            _stop = true;
+        }
+        _wake.notify_all();
+
+        for (auto& worker : _workers)
+        {
+            worker.join();
+        }
+    }
+
+    size_t size() const noexcept
+    {
+        return _workers.size();
+    }
+
+    /// @brief 提交一个任务，任务轮流分配到各个工作线程的队列中
+    void submit(task t)
+    {
+        auto index = _next_queue.fetch_add(1, std::memory_order_relaxed) % _queues.size();
+        {
+            std::lock_guard lock(_mutex);
+            ++_pending;
+            ++_queued;
+        }
+        {
+            std::lock_guard lock(_queues[index].mutex);
+            _queues[index].tasks.push_back(std::move(t));
+        }
+        _wake.notify_one();
+    }
+
+    /// @brief 阻塞直到所有已提交的任务执行完毕
+    void wait()
+    {
+        std::unique_lock lock(_mutex);
+        _done.wait(lock, [this] { return _pending == 0; });
+    }
+
+    /// @brief 最多阻塞timeout，返回所有任务是否已经执行完毕
+    template <typename Rep, typename Period>
+    bool wait_for(const std::chrono::duration<Rep, Period>& timeout)
+    {
+        std::unique_lock lock(_mutex);
+        return _done.wait_for(lock, timeout, [this] { return _pending == 0; });
+    }
+
+private:
+    struct work_queue
+    {
+        std::mutex mutex;
+        std::deque<task> tasks;
+    };
+
+    bool pop_local(size_t index, task& t)
+    {
+        auto& q = _queues[index];
+        std::lock_guard lock(q.mutex);
+        if (q.tasks.empty())
+        {
+            return false;
+        }
+        t = std::move(q.tasks.back());
+        q.tasks.pop_back();
+        _queued.fetch_sub(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    bool steal(size_t thief, task& t)
+    {
+        for (size_t i = 1; i < _queues.size(); ++i)
+        {
+            auto& q = _queues[(thief + i) % _queues.size()];
+            std::lock_guard lock(q.mutex);
+            if (!q.tasks.empty())
+            {
+                t = std::move(q.tasks.front());
+                q.tasks.pop_front();
+                _queued.fetch_sub(1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void worker_loop(size_t index)
+    {
+        while (true)
+        {
+            task t;
+            if (pop_local(index, t) || steal(index, t))
+            {
+                t();
+
+                std::lock_guard lock(_mutex);
+                if (--_pending == 0)
+                {
+                    _done.notify_all();
+                }
+                continue;
+            }
+
+            std::unique_lock lock(_mutex);
+            if (_stop)
+            {
+                return;
+            }
+            // 还有未被取走的任务时不进入等待，重新尝试窃取
+            _wake.wait(lock, [this] { return _stop || _queued.load(std::memory_order_relaxed) > 0; });
+        }
+    }
+
+private:
+    std::vector<work_queue> _queues;
+    std::vector<std::thread> _workers;
+    std::atomic<size_t> _next_queue { 0 };
+
+    std::mutex _mutex;
+    std::condition_variable _wake;
+    std::condition_variable _done;
+    std::atomic<size_t> _queued { 0 }; // 还在队列中、没有被取走的任务数
+    size_t _pending { 0 };             // 已提交但尚未执行完毕的任务数
+    bool _stop { false };
+};
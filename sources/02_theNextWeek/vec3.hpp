@@ -4,95 +4,97 @@
 #include <cmath>
 #include <iostream>
 
-class vec3
+/// @brief 三维向量，模板参数是标量类型，渲染使用vec3 = basic_vec3<real>
+template <typename T>
+class basic_vec3
 {
 public:
-    constexpr vec3() noexcept = default;
+    constexpr basic_vec3() noexcept = default;
 
-    constexpr vec3(double v) noexcept
+    constexpr basic_vec3(T v) noexcept
         : _e { v, v, v }
     {
     }
 
-    constexpr vec3(double x, double y, double z) noexcept
+    constexpr basic_vec3(T x, T y, T z) noexcept
         : _e { x, y, z }
     {
     }
 
-    std::array<double, 3> e() const noexcept
+    std::array<T, 3> e() const noexcept
     {
         return _e;
     }
 
-    [[nodiscard]] constexpr double x() const noexcept
+    [[nodiscard]] constexpr T x() const noexcept
     {
-        return _e.at(0);
+        return _e[0];
     }
 
-    [[nodiscard]] constexpr double y() const noexcept
+    [[nodiscard]] constexpr T y() const noexcept
     {
-        return _e.at(1);
+        return _e[1];
     }
 
-    [[nodiscard]] constexpr double z() const noexcept
+    [[nodiscard]] constexpr T z() const noexcept
     {
-        return _e.at(2);
+        return _e[2];
     }
 
-    [[nodiscard]] constexpr double operator[](size_t i) const
+    [[nodiscard]] constexpr T operator[](size_t i) const
     {
-        return _e.at(i);
+        return _e[i];
     }
 
-    [[nodiscard]] constexpr vec3 operator-() const noexcept
+    [[nodiscard]] constexpr basic_vec3 operator-() const noexcept
     {
-        return vec3(-_e[0], -_e[1], -_e[2]);
+        return basic_vec3(-_e[0], -_e[1], -_e[2]);
     }
 
-    [[nodiscard]] constexpr double& operator[](size_t i)
+    [[nodiscard]] constexpr T& operator[](size_t i)
     {
-        return _e.at(i);
+        return _e[i];
     }
 
-    [[nodiscard]] constexpr vec3& operator*=(const double t) noexcept
+    [[nodiscard]] constexpr basic_vec3& operator*=(const T t) noexcept
     {
-        _e.at(0) *= t;
-        _e.at(1) *= t;
-        _e.at(2) *= t;
+        _e[0] *= t;
+        _e[1] *= t;
+        _e[2] *= t;
         return *this;
     }
 
-    constexpr vec3& operator+=(const vec3& v) noexcept
+    constexpr basic_vec3& operator+=(const basic_vec3& v) noexcept
     {
-        _e.at(0) += v.x();
-        _e.at(1) += v.y();
-        _e.at(2) += v.z();
+        _e[0] += v.x();
+        _e[1] += v.y();
+        _e[2] += v.z();
         return *this;
     }
 
-    [[nodiscard]] constexpr vec3& operator/=(const double t)
+    [[nodiscard]] constexpr basic_vec3& operator/=(const T t)
     {
         return *this *= 1 / t;
     }
 
-    [[nodiscard]] double length() const noexcept
+    [[nodiscard]] T length() const noexcept
     {
         return std::hypot(_e[0], _e[1], _e[2]);
     }
 
-    [[nodiscard]] constexpr double length_squared() const noexcept
+    [[nodiscard]] constexpr T length_squared() const noexcept
     {
         return _e[0] * _e[0] + _e[1] * _e[1] + _e[2] * _e[2];
     }
 
-    inline static vec3 random()
+    inline static basic_vec3 random()
     {
-        return vec3(random_double(), random_double(), random_double());
+        return basic_vec3(random_double(), random_double(), random_double());
     }
 
-    inline static vec3 random(double min, double max)
+    inline static basic_vec3 random(T min, T max)
     {
-        return vec3(random_double(min, max), random_double(min, max), random_double(min, max));
+        return basic_vec3(random_double(min, max), random_double(min, max), random_double(min, max));
     }
 
     void write_color(std::ostream& out, int samples_per_pixel) const noexcept
@@ -108,66 +110,71 @@ public:
             << static_cast<int>(256 * clamp(b, 0.0, 0.999)) << '\n';
     }
 
-    friend std::ostream& operator<<(std::ostream& out, const vec3& v)
+    friend std::ostream& operator<<(std::ostream& out, const basic_vec3& v)
     {
         return out << v._e[0] << ' ' << v._e[1] << ' ' << v._e[2];
     }
 
-    friend vec3 operator+(const vec3& u, const vec3& v)
+    friend basic_vec3 operator+(const basic_vec3& u, const basic_vec3& v)
     {
-        return vec3(u._e[0] + v._e[0], u._e[1] + v._e[1], u._e[2] + v._e[2]);
+        return basic_vec3(u._e[0] + v._e[0], u._e[1] + v._e[1], u._e[2] + v._e[2]);
     }
 
-    friend vec3 operator-(const vec3& u, const vec3& v)
+    friend basic_vec3 operator-(const basic_vec3& u, const basic_vec3& v)
     {
-        return vec3(u._e[0] - v._e[0], u._e[1] - v._e[1], u._e[2] - v._e[2]);
+        return basic_vec3(u._e[0] - v._e[0], u._e[1] - v._e[1], u._e[2] - v._e[2]);
     }
 
-    friend vec3 operator*(const vec3& u, const vec3& v)
+    friend basic_vec3 operator*(const basic_vec3& u, const basic_vec3& v)
     {
-        return vec3(u._e[0] * v._e[0], u._e[1] * v._e[1], u._e[2] * v._e[2]);
+        return basic_vec3(u._e[0] * v._e[0], u._e[1] * v._e[1], u._e[2] * v._e[2]);
     }
 
-    friend vec3 operator*(double t, const vec3& v)
+    friend basic_vec3 operator*(T t, const basic_vec3& v)
     {
-        return vec3(t * v._e[0], t * v._e[1], t * v._e[2]);
+        return basic_vec3(t * v._e[0], t * v._e[1], t * v._e[2]);
     }
 
-    friend vec3 operator*(const vec3& v, double t)
+    friend basic_vec3 operator*(const basic_vec3& v, T t)
     {
         return t * v;
     }
 
-    friend vec3 operator/(vec3 v, double t)
+    friend basic_vec3 operator/(basic_vec3 v, T t)
     {
         return (1 / t) * v;
     }
 
-    friend double dot(const vec3& u, const vec3& v)
+    friend T dot(const basic_vec3& u, const basic_vec3& v)
     {
         return u._e[0] * v._e[0] + u._e[1] * v._e[1] + u._e[2] * v._e[2];
     }
 
-    friend vec3 cross(const vec3& u, const vec3& v)
+    friend basic_vec3 cross(const basic_vec3& u, const basic_vec3& v)
     {
-        return vec3(u._e[1] * v._e[2] - u._e[2] * v._e[1], u._e[2] * v._e[0] - u._e[0] * v._e[2], u._e[0] * v._e[1] - u._e[1] * v._e[0]);
+        return basic_vec3(u._e[1] * v._e[2] - u._e[2] * v._e[1], u._e[2] * v._e[0] - u._e[0] * v._e[2], u._e[0] * v._e[1] - u._e[1] * v._e[0]);
     }
 
-    friend vec3 unit_vector(vec3 v)
+    friend basic_vec3 unit_vector(basic_vec3 v)
     {
         return v / v.length();
     }
 
 private:
-    std::array<double, 3> _e { 0.0, 0.0, 0.0 };
+    std::array<T, 3> _e { 0, 0, 0 };
 };
 
+using vec3 = basic_vec3<real>;
+
 // 在球体内生成一个随机点
 vec3 random_in_unit_sphere()
 {
+    auto& generator = thread_rng();
     while (true)
     {
-        auto p = vec3::random(-1, 1);
+        double u[3];
+        generator.fill(u);
+        auto p = vec3(2 * u[0] - 1, 2 * u[1] - 1, 2 * u[2] - 1);
         if (p.length_squared() >= 1)
             continue;
         return p;
@@ -178,8 +185,10 @@ vec3 random_in_unit_sphere()
 // 使用极坐标在球体生成一个随机点
 vec3 random_unit_vector()
 {
-    auto a = random_double(0.0, 2 * pi);
-    auto z = random_double(-1.0, 1.0);
+    double u[2];
+    thread_rng().fill(u);
+    auto a = 2 * pi * u[0];
+    auto z = 2 * u[1] - 1;
     auto r = sqrt(1 - z * z);
     auto p = vec3(r * cos(a), r * sin(a), z);
     return p;
@@ -201,7 +210,7 @@ vec3 reflect(const vec3& v, const vec3& n)
 }
 
 // 折射
-vec3 refract(const vec3& uv, const vec3& n, double etai_over_etat)
+vec3 refract(const vec3& uv, const vec3& n, real etai_over_etat)
 {
     auto cos_theta      = dot(-uv, n);
     vec3 r_out_parallel = etai_over_etat * (uv + cos_theta * n);
@@ -209,21 +218,35 @@ vec3 refract(const vec3& uv, const vec3& n, double etai_over_etat)
     return r_out_parallel + r_out_perp;
 }
 
-double schlick(double cosine, double ref_idx)
+real schlick(real cosine, real ref_idx)
 {
     auto r0 = (1 - ref_idx) / (1 + ref_idx);
     r0      = r0 * r0;
     return r0 + (1 - r0) * pow((1 - cosine), 5);
 }
 
+/// @brief 以单位向量n为z轴的正交基，b1、b2与n两两垂直（Duff等人的无分支构造）
+inline void orthonormal_basis(const vec3& n, vec3& b1, vec3& b2)
+{
+    const real sign = std::copysign(real(1), n.z());
+    const real a    = -1 / (sign + n.z());
+    const real b    = n.x() * n.y() * a;
+    b1              = vec3(1 + sign * n.x() * n.x() * a, sign * b, -sign * n.x());
+    b2              = vec3(b, sign + n.y() * n.y() * a, -n.y());
+}
+
 // 从一个单位小圆盘射出光线
+// u0, u1是[0, 1)上的均匀分布，使用极坐标映射代替拒绝采样，不需要循环
+vec3 random_in_unit_disk(real u0, real u1)
+{
+    auto r = sqrt(u0);
+    auto a = 2 * pi * u1;
+    return vec3(r * cos(a), r * sin(a), 0);
+}
+
 vec3 random_in_unit_disk()
 {
-    while (true)
-    {
-        auto p = vec3(random_double(-1, 1), random_double(-1, 1), 0);
-        if (p.length_squared() >= 1)
-            continue;
-        return p;
-    }
-}
\ No newline at end of file
+    double u[2];
+    thread_rng().fill(u);
+    return random_in_unit_disk(u[0], u[1]);
+}
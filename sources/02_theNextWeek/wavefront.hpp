@@ -0,0 +1,298 @@
+#pragma once
+
+#include "camera.hpp"
+#include "hittable.hpp"
+#include "integrator.hpp"
+#include "material.hpp"
+#include "renderer.hpp"
+#include "stats.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <vector>
+
+/// @brief 波前（wavefront）路径追踪中的一批路径，按结构数组存储
+/// 所有路径同时生成、同时弹射，第depth轮处理的都是第depth次弹射的光线
+struct path_queue
+{
+    std::vector<real> origin[3];
+    std::vector<real> direction[3];
+    std::vector<real> time;
+    std::vector<real> throughput[3]; // 路径到目前为止的衰减
+    std::vector<uint32_t> pixel;       // 路径所属的像素在分块累加缓冲中的下标
+    std::vector<uint64_t> seed;        // 路径的随机数种子，每次弹射用(seed, depth)重新设置随机数生成器
+
+    size_t size() const noexcept
+    {
+        return pixel.size();
+    }
+
+    void clear() noexcept
+    {
+        for (size_t a = 0; a < 3; ++a)
+        {
+            origin[a].clear();
+            direction[a].clear();
+            throughput[a].clear();
+        }
+        time.clear();
+        pixel.clear();
+        seed.clear();
+    }
+
+    void push(const ray& r, const vec3& beta, uint32_t pixel_index, uint64_t path_seed)
+    {
+        const vec3 o = r.origin();
+        const vec3 d = r.direction();
+        for (size_t a = 0; a < 3; ++a)
+        {
+            origin[a].push_back(o[a]);
+            direction[a].push_back(d[a]);
+            throughput[a].push_back(beta[a]);
+        }
+        time.push_back(r.time());
+        pixel.push_back(pixel_index);
+        seed.push_back(path_seed);
+    }
+
+    ray get_ray(size_t i) const noexcept
+    {
+        return ray(vec3(origin[0][i], origin[1][i], origin[2][i]), vec3(direction[0][i], direction[1][i], direction[2][i]), time[i]);
+    }
+
+    vec3 get_throughput(size_t i) const noexcept
+    {
+        return vec3(throughput[0][i], throughput[1][i], throughput[2][i]);
+    }
+};
+
+/// @brief 一个分块的波前渲染状态，每个工作线程处理一个分块时使用
+class wavefront_tile_renderer
+{
+public:
+    /// @brief 一批最多同时追踪的路径数，分块的样本更多时分成多批
+    static constexpr size_t batch_size = 1 << 14;
+
+    wavefront_tile_renderer(const render_settings& settings, const camera& cam, const hittable& world, const material_table& materials, int max_depth) noexcept
+        : _settings(settings)
+        , _cam(cam)
+        , _world(world)
+        , _materials(materials)
+        , _max_depth(max_depth)
+    {
+    }
+
+    /// @brief 渲染一个分块，结果累加到image中分块对应的像素
+    void render(const tile& t, framebuffer& image)
+    {
+        const int tile_width  = t.x1 - t.x0;
+        const int tile_height = t.y1 - t.y0;
+        const size_t spp      = static_cast<size_t>(_settings.samples_per_pixel);
+        const size_t paths    = static_cast<size_t>(tile_width) * tile_height * spp;
+
+        _accum.assign(static_cast<size_t>(tile_width) * tile_height, vec3(0, 0, 0));
+
+        for (size_t first = 0; first < paths; first += batch_size)
+        {
+            generate(t, first, std::min(paths, first + batch_size));
+            for (int depth = 0; depth < _max_depth && _queue.size() > 0; ++depth)
+            {
+                intersect(t, depth);
+                shade(depth);
+                compact();
+            }
+            // 达到最大弹射次数的路径贡献为0，与ray_color相同
+            stats::count_path_end(path_end::depth_limit, _queue.size());
+        }
+
+        for (int y = t.y0; y < t.y1; ++y)
+        {
+            for (int x = t.x0; x < t.x1; ++x)
+            {
+                image.add(x, y, _accum[static_cast<size_t>(y - t.y0) * tile_width + (x - t.x0)], static_cast<uint32_t>(spp));
+            }
+        }
+    }
+
+private:
+    /// @brief 生成[first, last)范围内的主光线，路径序号 = 分块内像素序号 * spp + 样本序号
+    void generate(const tile& t, size_t first, size_t last)
+    {
+        const int width      = _settings.image_width;
+        const int height     = _settings.image_height;
+        const int tile_width = t.x1 - t.x0;
+        const size_t spp     = static_cast<size_t>(_settings.samples_per_pixel);
+
+        _queue.clear();
+        auto& generator = thread_rng();
+        for (size_t path = first; path < last; ++path)
+        {
+            const auto local = static_cast<uint32_t>(path / spp);
+            const int i      = t.x0 + static_cast<int>(local % tile_width);
+            const int y      = t.y0 + static_cast<int>(local / tile_width);
+            const int j      = height - 1 - y;
+
+            // 种子只取决于像素在整幅图像中的位置和样本序号，与分块大小、线程数无关
+            const auto pixel_index = static_cast<uint64_t>(y) * width + i;
+            const uint64_t seed    = hash_seed(hash_seed(_settings.seed, pixel_index), path % spp);
+            generator.seed(seed);
+
+            double jitter[2];
+            generator.fill(jitter);
+            auto u = (i + jitter[0]) / width;
+            auto v = (j + jitter[1]) / height;
+            _queue.push(_cam.get_ray(u, v), vec3(1, 1, 1), local, seed);
+        }
+    }
+
+    /// @brief 所有活动路径与场景求交，没有击中的路径累加背景色并结束
+    void intersect(const tile& t, int depth)
+    {
+        const int tile_width = t.x1 - t.x0;
+        const size_t n       = _queue.size();
+        _hits.resize(n);
+        _alive.assign(n, 0);
+
+        for (auto& bucket : _buckets)
+        {
+            bucket.clear();
+        }
+
+        for (size_t i = 0; i < n; ++i)
+        {
+            const ray r     = _queue.get_ray(i);
+            const auto cost = stats::thread_cost();
+            const bool hit  = _world.hit(r, 0.001, infinity, _hits[i]);
+
+            stats::count_ray(depth, hit);
+            if constexpr (stats::enabled)
+            {
+                const auto local = _queue.pixel[i];
+                const auto x     = t.x0 + static_cast<int>(local % tile_width);
+                const auto y     = t.y0 + static_cast<int>(local / tile_width);
+                stats::add_pixel_cost(static_cast<size_t>(y) * _settings.image_width + x, stats::thread_cost() - cost);
+            }
+
+            if (hit)
+            {
+                // 按材质类型分组，同一种材质连续着色
+                _buckets[static_cast<size_t>(_materials.kind(_hits[i].material_id))].push_back(static_cast<uint32_t>(i));
+            }
+            else
+            {
+                _accum[_queue.pixel[i]] += _queue.get_throughput(i) * background(r);
+                stats::count_path_end(path_end::escaped);
+            }
+        }
+    }
+
+    /// @brief 按材质分组着色，每组是一个只有一种材质的紧凑循环
+    void shade(int depth)
+    {
+        shade_bucket<lambertian>(_buckets[static_cast<size_t>(material_kind::lambertian)], depth);
+        shade_bucket<metal>(_buckets[static_cast<size_t>(material_kind::metal)], depth);
+        shade_bucket<dielectric>(_buckets[static_cast<size_t>(material_kind::dielectric)], depth);
+        shade_bucket<diffuse_light>(_buckets[static_cast<size_t>(material_kind::diffuse_light)], depth);
+        shade_bucket<glossy>(_buckets[static_cast<size_t>(material_kind::glossy)], depth);
+    }
+
+    /// @brief 分组内的材质类型都是Material，直接调用Material::scatter，不需要按类型分发，发光的材质先累加发出的光
+    template <typename Material>
+    void shade_bucket(const std::vector<uint32_t>& bucket, int depth)
+    {
+        auto& generator = thread_rng();
+        for (auto i : bucket)
+        {
+            const auto& rec = _hits[i];
+            const auto& m   = *std::get_if<Material>(&_materials[rec.material_id]);
+
+            generator.seed(hash_seed(_queue.seed[i], static_cast<uint64_t>(depth) + 1));
+
+            if constexpr (requires { m.emitted(rec); })
+            {
+                _accum[_queue.pixel[i]] += _queue.get_throughput(i) * m.emitted(rec);
+            }
+
+            ray scattered;
+            vec3 attenuation;
+            if (!m.scatter(_queue.get_ray(i), rec, attenuation, scattered))
+            {
+                stats::count_path_end(path_end::absorbed);
+                continue; // 被吸收
+            }
+
+            const vec3 o = scattered.origin();
+            const vec3 d = scattered.direction();
+            for (size_t a = 0; a < 3; ++a)
+            {
+                _queue.origin[a][i]    = o[a];
+                _queue.direction[a][i] = d[a];
+                _queue.throughput[a][i] *= attenuation[a];
+            }
+            _queue.time[i] = scattered.time();
+            _alive[i]      = 1;
+        }
+    }
+
+    /// @brief 删除已经结束的路径，保持剩余路径的顺序
+    void compact()
+    {
+        size_t out = 0;
+        for (size_t i = 0; i < _queue.size(); ++i)
+        {
+            if (!_alive[i])
+            {
+                continue;
+            }
+            for (size_t a = 0; a < 3; ++a)
+            {
+                _queue.origin[a][out]     = _queue.origin[a][i];
+                _queue.direction[a][out]  = _queue.direction[a][i];
+                _queue.throughput[a][out] = _queue.throughput[a][i];
+            }
+            _queue.time[out]  = _queue.time[i];
+            _queue.pixel[out] = _queue.pixel[i];
+            _queue.seed[out]  = _queue.seed[i];
+            ++out;
+        }
+
+        for (size_t a = 0; a < 3; ++a)
+        {
+            _queue.origin[a].resize(out);
+            _queue.direction[a].resize(out);
+            _queue.throughput[a].resize(out);
+        }
+        _queue.time.resize(out);
+        _queue.pixel.resize(out);
+        _queue.seed.resize(out);
+    }
+
+private:
+    const render_settings& _settings;
+    const camera& _cam;
+    const hittable& _world;
+    const material_table& _materials;
+    int _max_depth;
+
+    path_queue _queue;
+    std::vector<hit_record> _hits;
+    std::vector<uint8_t> _alive;
+    std::array<std::vector<uint32_t>, material_kind_count> _buckets; // 按material_kind分组的路径下标
+    std::vector<vec3> _accum;                      // 分块内每个像素的样本颜色之和
+};
+
+/// @brief 波前路径追踪：每个分块的所有样本一起生成，按弹射次数逐轮求交、按材质分组着色、删除结束的路径
+/// 与ray_color的期望相同，随机数按(像素, 样本, 弹射次数)设置种子，结果与线程数无关
+/// @return 帧缓冲，格式与render_tiles相同
+inline framebuffer render_wavefront(const render_settings& settings, const camera& cam, const hittable& world, const material_table& materials, int max_depth)
+{
+    framebuffer image(settings.image_width, settings.image_height);
+
+    for_each_tile(settings, [&](const tile& t) {
+        wavefront_tile_renderer renderer(settings, cam, world, materials, max_depth);
+        renderer.render(t, image);
+    });
+
+    return image;
+}